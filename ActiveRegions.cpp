@@ -0,0 +1,256 @@
+#include "ActiveRegions.h"
+#include <string.h>
+
+
+ActiveRegionTracker::ActiveRegionTracker() :
+m_heightFunction(NULL), m_envelopeFunction(NULL), m_stride(1)
+{
+	memset(m_dirty, 0, sizeof(m_dirty));
+	memset(m_settled, 0, sizeof(m_settled));
+}
+
+ActiveRegionTracker::~ActiveRegionTracker()
+{
+}
+
+//everything starts out dirty so the first upload carries the x and z components as well
+void ActiveRegionTracker::Init(HeightFunction heightFunction, EnvelopeFunction envelopeFunction)
+{
+	m_heightFunction = heightFunction;
+	m_envelopeFunction = envelopeFunction;
+	memset(m_settled, 0, sizeof(m_settled));
+	MarkAllDirty();
+}
+
+/*
+function: Update
+Brings every tile of the surface up to date with the given iteration, skipping the quiet ones.
+Parameters:
+    vertexPositions: the interleaved x, y, z array; only the y components are written
+    iteration: passed to the height and envelope functions
+Return Value: the number of tiles that became dirty
+*/
+int ActiveRegionTracker::Update(float* vertexPositions, int iteration)
+{
+	int numChanged = 0;
+	for (int tile = 0; tile < NUM_TILES; tile++)
+		numChanged += UpdateTile(tile, vertexPositions, iteration);
+	return numChanged;
+}
+
+/*
+function: UpdateTile
+Brings one tile up to date. Tiles don't share any state, so different tiles can be updated from different threads.
+Return Value: 1 if the tile was rewritten, 0 if it was skipped or did not move enough
+*/
+int ActiveRegionTracker::UpdateTile(int tile, float* vertexPositions, int iteration)
+{
+	long x0, z0, x1, z1;
+	GetTileBounds(tile, &x0, &z0, &x1, &z1);
+
+	double envelope = m_envelopeFunction(x0, z0, x1, z1, iteration);
+	if (envelope <= ACTIVE_EPSILON)
+	{
+		//one more pass brings the tile to rest, and after that there is nothing left to do
+		if (m_settled[tile])
+			return 0;
+		m_settled[tile] = 1;
+	}
+	else
+	{
+		m_settled[tile] = 0;
+	}
+
+	//evaluate the samples, which at a stride of 1 are just the vertices of the tile
+	long sampleX[ACTIVE_TILE_SIZE + 1], sampleZ[ACTIVE_TILE_SIZE + 1];
+	int numSamplesX = i_SamplePositions(x0, x1, NUM_VERTICES_X, sampleX);
+	int numSamplesZ = i_SamplePositions(z0, z1, NUM_VERTICES_Z, sampleZ);
+	float samples[(ACTIVE_TILE_SIZE + 1)*(ACTIVE_TILE_SIZE + 1)];
+	for (int b = 0; b < numSamplesZ; b++)
+	{
+		for (int a = 0; a < numSamplesX; a++)
+			samples[b*numSamplesX + a] = m_heightFunction(sampleX[a], sampleZ[b], iteration);
+	}
+
+	//then fill in the vertices. A quiet tile goes into a scratch tile first, so that if it barely moved it keeps
+	//exactly what was uploaded, but comparing a tile that is clearly moving would only be extra work
+	int compare = envelope <= ACTIVE_COMPARE_ENVELOPE;
+	float heights[ACTIVE_TILE_SIZE*ACTIVE_TILE_SIZE];
+	float maxChange = 0.0;
+	int idx = 0;
+	for (long z = z0; z < z1; z++)
+	{
+		//every vertex lies between sample b and the next one, or on the last sample
+		int b = (z - z0) / m_stride;
+		int down = b < numSamplesZ - 1 ? numSamplesX : 0;
+		float fz = down ? (float)(z - sampleZ[b]) / (sampleZ[b + 1] - sampleZ[b]) : 0.0;
+		for (long x = x0; x < x1; x++)
+		{
+			int a = (x - x0) / m_stride;
+			int right = a < numSamplesX - 1 ? 1 : 0;
+			float fx = right ? (float)(x - sampleX[a]) / (sampleX[a + 1] - sampleX[a]) : 0.0;
+			const float* sample = &samples[b*numSamplesX + a];
+			float nearHeight = sample[0] + (sample[right] - sample[0])*fx;
+			float farHeight = sample[down] + (sample[down + right] - sample[down])*fx;
+			float height = nearHeight + (farHeight - nearHeight)*fz;
+			if (!compare)
+			{
+				vertexPositions[(z*NUM_VERTICES_X + x)*3 + 1] = height;
+				continue;
+			}
+			float change = fabsf(height - vertexPositions[(z*NUM_VERTICES_X + x)*3 + 1]);
+			if (change > maxChange) maxChange = change;
+			heights[idx++] = height;
+		}
+	}
+	if (compare)
+	{
+		if (maxChange <= ACTIVE_EPSILON)
+			return 0;
+		idx = 0;
+		for (long z = z0; z < z1; z++)
+		{
+			for (long x = x0; x < x1; x++)
+				vertexPositions[(z*NUM_VERTICES_X + x)*3 + 1] = heights[idx++];
+		}
+	}
+	m_dirty[tile] = 1;
+	return 1;
+}
+
+//a different stride changes vertices even in tiles that had come to rest, so they all have to be looked at again
+void ActiveRegionTracker::SetStride(int stride)
+{
+	if (stride == m_stride)
+		return;
+	m_stride = stride;
+	memset(m_settled, 0, sizeof(m_settled));
+}
+
+void ActiveRegionTracker::MarkAllDirty()
+{
+	memset(m_dirty, 1, sizeof(m_dirty));
+}
+
+void ActiveRegionTracker::ClearDirty()
+{
+	memset(m_dirty, 0, sizeof(m_dirty));
+}
+
+void ActiveRegionTracker::ClearTileDirty(int tile)
+{
+	m_dirty[tile] = 0;
+}
+
+int ActiveRegionTracker::IsTileDirty(int tile)
+{
+	return m_dirty[tile];
+}
+
+//the bounds are half open, [x0, x1) x [z0, z1), and the tiles on the far edges may be narrower
+void ActiveRegionTracker::GetTileBounds(int tile, long* x0, long* z0, long* x1, long* z1)
+{
+	(*x0) = (tile % NUM_TILES_X)*ACTIVE_TILE_SIZE;
+	(*z0) = (tile / NUM_TILES_X)*ACTIVE_TILE_SIZE;
+	(*x1) = (*x0) + ACTIVE_TILE_SIZE < NUM_VERTICES_X ? (*x0) + ACTIVE_TILE_SIZE : NUM_VERTICES_X;
+	(*z1) = (*z0) + ACTIVE_TILE_SIZE < NUM_VERTICES_Z ? (*z0) + ACTIVE_TILE_SIZE : NUM_VERTICES_Z;
+}
+
+/*
+function: GetDirtyRanges
+Turns the dirty tiles into runs of the vertex array for glBufferSubData.
+A tile is one run per row, so the runs are walked row by row, which keeps them in order, and any run that
+starts within UPLOAD_MERGE_GAP floats of the end of the previous one is folded into it. That joins neighbouring
+tiles in a row, and whole rows when a full row of tiles is dirty.
+Parameters:
+    ranges: set to an array owned by the tracker, valid until the next call
+Return Value: the number of ranges
+*/
+int ActiveRegionTracker::GetDirtyRanges(const stRange** ranges)
+{
+	int numRanges = 0;
+	for (long z = 0; z < NUM_VERTICES_Z; z++)
+	{
+		const char* tileRow = &m_dirty[(z / ACTIVE_TILE_SIZE)*NUM_TILES_X];
+		for (long tx = 0; tx < NUM_TILES_X; tx++)
+		{
+			if (!tileRow[tx])
+				continue;
+			long x0 = tx*ACTIVE_TILE_SIZE;
+			long x1 = x0 + ACTIVE_TILE_SIZE < NUM_VERTICES_X ? x0 + ACTIVE_TILE_SIZE : NUM_VERTICES_X;
+			numRanges = i_AppendRange(numRanges, (z*NUM_VERTICES_X + x0)*3, (z*NUM_VERTICES_X + x1)*3);
+		}
+	}
+	(*ranges) = m_ranges;
+	return numRanges;
+}
+
+/*
+* Tile major order keeps every tile in one run of vertices: the tiles follow each other row of tiles by row of
+* tiles, and the vertices of each tile are row major within it. Every row of tiles before this one is
+* ACTIVE_TILE_SIZE deep, and every tile before this one in its row is ACTIVE_TILE_SIZE wide.
+*/
+long ActiveRegionTracker::GetTileOffset(int tile)
+{
+	long x0, z0, x1, z1;
+	GetTileBounds(tile, &x0, &z0, &x1, &z1);
+	return z0*NUM_VERTICES_X + (z1 - z0)*x0;
+}
+
+//where vertex (x, z) of the grid lands in tile major order
+long ActiveRegionTracker::GetTileMajorIndex(long x, long z)
+{
+	int tile = (z / ACTIVE_TILE_SIZE)*NUM_TILES_X + x / ACTIVE_TILE_SIZE;
+	long x0, z0, x1, z1;
+	GetTileBounds(tile, &x0, &z0, &x1, &z1);
+	return GetTileOffset(tile) + (z - z0)*(x1 - x0) + (x - x0);
+}
+
+/*
+function: PackTile
+Copies the x, y, z of every vertex in the tile out of the row major vertex array into its run of a tile major
+one, so the whole tile can be uploaded with one call.
+*/
+void ActiveRegionTracker::PackTile(int tile, const float* vertexPositions, float* tileMajorPositions)
+{
+	long x0, z0, x1, z1;
+	GetTileBounds(tile, &x0, &z0, &x1, &z1);
+	float* packed = tileMajorPositions + GetTileOffset(tile)*3;
+	for (long z = z0; z < z1; z++)
+	{
+		memcpy(packed, &vertexPositions[(z*NUM_VERTICES_X + x0)*3], sizeof(float)*(x1 - x0)*3);
+		packed += (x1 - x0)*3;
+	}
+}
+
+
+
+//folds [offset, end) into the last range when it starts within UPLOAD_MERGE_GAP floats of it, returns the new number of ranges
+int ActiveRegionTracker::i_AppendRange(int numRanges, long offset, long end)
+{
+	stRange* previous = numRanges ? &m_ranges[numRanges - 1] : NULL;
+	if (previous && offset - (previous->offset + previous->count) <= UPLOAD_MERGE_GAP)
+	{
+		previous->count = end - previous->offset;
+		return numRanges;
+	}
+	m_ranges[numRanges].offset = offset;
+	m_ranges[numRanges].count = end - offset;
+	return numRanges + 1;
+}
+
+/*
+* The positions in [lo, hi) that get evaluated at the current stride: every stride'th one from lo, plus one more
+* past the last vertex of the tile when that vertex doesn't fall on the stride. The extra one is the first
+* sample of the next tile, so both tiles interpolate the shared stretch from the same values, or the last vertex
+* of the grid when there is no next tile.
+*/
+int ActiveRegionTracker::i_SamplePositions(long lo, long hi, long numVertices, long* positions)
+{
+	int count = 0;
+	for (long position = lo; position < hi; position += m_stride)
+		positions[count++] = position;
+	if (positions[count - 1] != hi - 1)
+		positions[count++] = hi < numVertices ? hi : numVertices - 1;
+	return count;
+}
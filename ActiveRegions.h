@@ -0,0 +1,66 @@
+#ifndef ACTIVE_REGIONS_HEADER_INCLUDE
+#define ACTIVE_REGIONS_HEADER_INCLUDE
+#include "CommonDefines.h"
+
+#define NUM_TILES_X ((NUM_VERTICES_X + ACTIVE_TILE_SIZE - 1) / ACTIVE_TILE_SIZE)
+#define NUM_TILES_Z ((NUM_VERTICES_Z + ACTIVE_TILE_SIZE - 1) / ACTIVE_TILE_SIZE)
+#define NUM_TILES (NUM_TILES_X*NUM_TILES_Z)
+
+//the samples of a coarse stride have to line up with the tile edges, so neighbouring tiles agree on them
+#if ACTIVE_TILE_SIZE % (1 << (RESOLUTION_LEVELS - 1))
+#error ACTIVE_TILE_SIZE has to be a multiple of the coarsest resolution stride
+#endif
+
+//a run of floats in the interleaved vertex array
+typedef struct
+{
+	long offset; //in floats from the start of the array
+	long count; //in floats
+} stRange;
+
+/*
+* This class keeps track of which tiles of the surface are actually moving.
+* A tile is skipped entirely once the envelope says that nothing in it can move by more than ACTIVE_EPSILON
+* (the wavefront has not reached it, or the damping has flattened it). A quiet tile, whose envelope is under
+* ACTIVE_COMPARE_ENVELOPE, is only rewritten, and marked dirty, when one of its heights has moved by more than
+* ACTIVE_EPSILON. Livelier tiles are always rewritten.
+* Dirty means changed since the last ClearDirty(), so whoever uploads the vertices decides when it is clean.
+* With a stride above 1 only every stride'th vertex in each direction is evaluated and the ones in between are
+* interpolated from them, so everything reading the vertices still sees a whole (if smoother) surface.
+* To upload a tile with a single call, PackTile() copies it into a tile major array, where every tile is one run.
+* Tiles are numbered row by row, tile = tz*NUM_TILES_X + tx.
+*/
+class ActiveRegionTracker
+{
+public:
+	ActiveRegionTracker();
+	~ActiveRegionTracker();
+	void Init(HeightFunction heightFunction, EnvelopeFunction envelopeFunction);
+	int Update(float* vertexPositions, int iteration);
+	int UpdateTile(int tile, float* vertexPositions, int iteration);
+	void SetStride(int stride);
+	void MarkAllDirty();
+	void ClearDirty();
+	void ClearTileDirty(int tile);
+	int IsTileDirty(int tile);
+	void GetTileBounds(int tile, long* x0, long* z0, long* x1, long* z1);
+	int GetDirtyRanges(const stRange** ranges);
+	long GetTileOffset(int tile);
+	long GetTileMajorIndex(long x, long z);
+	void PackTile(int tile, const float* vertexPositions, float* tileMajorPositions);
+
+private:
+	//data
+	HeightFunction m_heightFunction;
+	EnvelopeFunction m_envelopeFunction;
+	char m_dirty[NUM_TILES];
+	char m_settled[NUM_TILES]; //recomputed once since the envelope fell below ACTIVE_EPSILON
+	int m_stride;
+	stRange m_ranges[NUM_VERTICES_Z*NUM_TILES_X]; //worst case is one range per tile row
+
+	//private functions
+	int i_AppendRange(int numRanges, long offset, long end);
+	int i_SamplePositions(long lo, long hi, long numVertices, long* positions);
+};
+
+#endif //ACTIVE_REGIONS_HEADER_INCLUDE
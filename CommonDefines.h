@@ -10,7 +10,15 @@
 
 /* Compile options */
 #define OPENGL 1
+//OPENGL_DEBUG (KHR_debug messages, debug groups and object labels) comes from the makefile, and a RELEASE=1 build
+//leaves it out so it all compiles away
 //#define OPENCL 1
+//#define DOMAIN_DECOMPOSITION 1 //step the surface in worker processes, one per subdomain
+#define PUBLISH_HEIGHTFIELD 1 //share every frame's heights with other local processes through POSIX shared memory
+#define HEIGHTFIELD_QUERIES 1 //keep a min/max pyramid of the surface for height and ray queries
+#define ADAPTIVE_RESOLUTION 1 //coarsen the surface while frames run over their budget
+#define ACTIVE_REGIONS 1 //only recompute and upload the tiles of the surface that are moving
+//#define TILE_TASK_GRAPH 1 //compute, upload and draw each active region tile as soon as it is ready (needs ACTIVE_REGIONS)
 
 #define SUCCESS 0
 #define FAILURE 1
@@ -24,5 +32,44 @@
 
 #define ITERATIONS 10
 
+//the grid is split into NUM_DOMAINS_X*NUM_DOMAINS_Z rectangular subdomains when DOMAIN_DECOMPOSITION is on
+#define NUM_DOMAINS_X 2
+#define NUM_DOMAINS_Z 2
+#define NUM_DOMAINS NUM_DOMAINS_X*NUM_DOMAINS_Z
+
+//when ACTIVE_REGIONS is on, the grid is tracked in square tiles of this many vertices a side
+#define ACTIVE_TILE_SIZE 16
+//a tile whose heights all move less than this is left alone, and not uploaded
+#define ACTIVE_EPSILON 0.001
+//tiles that can move further than this are always rewritten, without checking first whether they moved at all.
+//Without RIPPLE_WAVE_SPEED or RIPPLE_DAMPING that is every tile, and ACTIVE_REGIONS only costs the tile bookkeeping
+#define ACTIVE_COMPARE_ENVELOPE (10*ACTIVE_EPSILON)
+//dirty ranges closer together than this many floats are uploaded in one call
+#define UPLOAD_MERGE_GAP 48
+
+//the least severe KHR_debug message that gets logged when OPENGL_DEBUG is on
+#define OPENGL_DEBUG_SEVERITY GL_DEBUG_SEVERITY_LOW
+//messages that can be waiting to be logged at once, any more than this are counted and dropped
+#define OPENGL_DEBUG_QUEUE_LENGTH 64
+
+//threads that compute tiles when TILE_TASK_GRAPH is on, the main thread helps as well
+#define NUM_WORKER_THREADS 3
+
+//ADAPTIVE_RESOLUTION keeps the timed part of a frame, which leaves out the swap, under this share of the display's
+//refresh interval. DEFAULT_REFRESH_RATE is used when SDL can't tell what the display runs at
+#define FRAME_BUDGET_FRACTION 0.75
+#define DEFAULT_REFRESH_RATE 60
+//resolution level n works on every (1 << n)th vertex in x and z
+#define RESOLUTION_LEVELS 4
+
+//shape of the ripple: leave these out for a surface that is moving everywhere, all the time
+//#define RIPPLE_WAVE_SPEED 0.5 //the ripple starts at the center and its front spreads this far per unit of time
+//#define RIPPLE_DAMPING 4.0 //the amplitude falls off as exp(-RIPPLE_DAMPING*distanceFromCenter)
+
+//the height of a single vertex at a given iteration, so the surface can be evaluated away from ripple.cpp
+typedef float (*HeightFunction)(long x, long z, int iteration);
+//an upper bound on the absolute height anywhere in the vertices [x0, x1) x [z0, z1) at a given iteration
+typedef double (*EnvelopeFunction)(long x0, long z0, long x1, long z1, int iteration);
+
 extern int g_windowHeight;
 extern int g_windowWidth;
@@ -0,0 +1,296 @@
+#include "DomainDecomposition.h"
+#include <string.h>
+#include <errno.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/prctl.h>
+#include <sys/mman.h>
+#include <sys/wait.h>
+#include <signal.h>
+
+
+DomainDecomposition::DomainDecomposition() :
+m_numWorkers(0), m_heightFunction(NULL), m_sharedMemory(NULL), m_sharedSize(0),
+m_control(NULL), m_halos(NULL), m_gather(NULL), m_edgeLength(0)
+{
+}
+
+DomainDecomposition::~DomainDecomposition()
+{
+}
+
+/*
+function: Init
+Partitions the grid, creates the shared mapping and forks one worker process per subdomain.
+Parameters:
+    heightFunction: evaluated by the workers for every vertex they own
+Return Value: SUCCESS when every worker is running. FAILURE otherwise
+*/
+int DomainDecomposition::Init(HeightFunction heightFunction)
+{
+	m_heightFunction = heightFunction;
+	i_PartitionGrid();
+
+	//lay out the mapping as control block, then the halo slots, then the gather buffer
+	size_t haloCount = (size_t)NUM_DOMAINS*NUM_EDGES*HALO_SLOTS*m_edgeLength;
+	m_sharedSize = sizeof(stDomainControl) + sizeof(float)*(haloCount + NUM_VERTICES);
+	m_sharedMemory = mmap(NULL, m_sharedSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_ANONYMOUS, -1, 0);
+	if (m_sharedMemory == MAP_FAILED)
+	{
+		printf("Could not map %lu bytes for the subdomains\n", (unsigned long)m_sharedSize);
+		m_sharedMemory = NULL;
+		return FAILURE;
+	}
+	m_control = (stDomainControl*)m_sharedMemory;
+	m_halos = (float*)(m_control + 1);
+	m_gather = m_halos + haloCount;
+	memset(m_control, 0, sizeof(stDomainControl));
+
+	//the barrier and semaphores live in the mapping, so they have to be marked as shared between processes
+	pthread_barrierattr_t attr;
+	pthread_barrierattr_init(&attr);
+	pthread_barrierattr_setpshared(&attr, PTHREAD_PROCESS_SHARED);
+	pthread_barrier_init(&m_control->haloBarrier, &attr, NUM_DOMAINS);
+	pthread_barrierattr_destroy(&attr);
+	sem_init(&m_control->stepSemaphore, 1, 0);
+	sem_init(&m_control->doneSemaphore, 1, 0);
+
+	pid_t coordinator = getpid();
+	for (int domain = 0; domain < NUM_DOMAINS; domain++)
+	{
+		pid_t pid = fork();
+		if (pid == 0)
+		{
+			i_WorkerLoop(domain, coordinator);
+			_exit(0); //skip the parent's atexit handlers and global destructors
+		}
+		if (pid < 0)
+		{
+			//the workers that did start would wait in the haloBarrier for the missing one forever
+			printf("Could not fork the worker for subdomain %d\n", domain);
+			i_KillWorkers();
+			return FAILURE;
+		}
+		m_workers[m_numWorkers++] = pid;
+	}
+	return SUCCESS;
+}
+
+/*
+function: Step
+Runs one step in every subdomain and gathers the heights.
+Parameters:
+    iteration: passed to the height function
+    vertexPositions: the interleaved x, y, z array; only the y components are written
+Return Value: SUCCESS when every worker completed the step. FAILURE otherwise, including when a worker has died,
+in which case all of them are gone afterwards
+*/
+int DomainDecomposition::Step(int iteration, float* vertexPositions)
+{
+	if (!m_sharedMemory)
+		return FAILURE;
+	m_control->step++;
+	m_control->iteration = iteration;
+	for (int i = 0; i < NUM_DOMAINS; i++)
+		sem_post(&m_control->stepSemaphore);
+	if (i_WaitForWorkers() != SUCCESS)
+	{
+		i_KillWorkers();
+		return FAILURE;
+	}
+	if (m_control->failed)
+		return FAILURE;
+
+	for (int idx = 0; idx < NUM_VERTICES; idx++)
+		vertexPositions[idx*3 + 1] = m_gather[idx];
+	return SUCCESS;
+}
+
+int DomainDecomposition::Shutdown()
+{
+	if (!m_sharedMemory)
+		return SUCCESS;
+	m_control->quit = 1;
+	for (int i = 0; i < NUM_DOMAINS; i++)
+		sem_post(&m_control->stepSemaphore);
+	for (int i = 0; i < m_numWorkers; i++)
+		waitpid(m_workers[i], NULL, 0);
+	m_numWorkers = 0;
+
+	pthread_barrier_destroy(&m_control->haloBarrier);
+	sem_destroy(&m_control->stepSemaphore);
+	sem_destroy(&m_control->doneSemaphore);
+	munmap(m_sharedMemory, m_sharedSize);
+	m_sharedMemory = NULL;
+	return SUCCESS;
+}
+
+
+
+//the remainder of an uneven split is spread over the subdomains rather than all landing on the last one
+void DomainDecomposition::i_PartitionGrid()
+{
+	m_edgeLength = 0;
+	for (int dz = 0; dz < NUM_DOMAINS_Z; dz++)
+	{
+		for (int dx = 0; dx < NUM_DOMAINS_X; dx++)
+		{
+			stSubdomain* domain = &m_domains[dz*NUM_DOMAINS_X + dx];
+			domain->x0 = dx*NUM_VERTICES_X / NUM_DOMAINS_X;
+			domain->z0 = dz*NUM_VERTICES_Z / NUM_DOMAINS_Z;
+			domain->width = (dx + 1)*NUM_VERTICES_X / NUM_DOMAINS_X - domain->x0;
+			domain->depth = (dz + 1)*NUM_VERTICES_Z / NUM_DOMAINS_Z - domain->z0;
+			if (domain->width > m_edgeLength) m_edgeLength = domain->width;
+			if (domain->depth > m_edgeLength) m_edgeLength = domain->depth;
+		}
+	}
+}
+
+float* DomainDecomposition::i_Edge(int domain, int edge, int slot)
+{
+	return m_halos + (((size_t)domain*NUM_EDGES + edge)*HALO_SLOTS + slot)*m_edgeLength;
+}
+
+//returns -1 on the outside of the grid
+int DomainDecomposition::i_Neighbour(int domain, int edge)
+{
+	int dx = domain % NUM_DOMAINS_X;
+	int dz = domain / NUM_DOMAINS_X;
+	switch (edge)
+	{
+		case EDGE_WEST:
+			return dx > 0 ? domain - 1 : -1;
+		case EDGE_EAST:
+			return dx < NUM_DOMAINS_X - 1 ? domain + 1 : -1;
+		case EDGE_SOUTH:
+			return dz > 0 ? domain - NUM_DOMAINS_X : -1;
+		case EDGE_NORTH:
+			return dz < NUM_DOMAINS_Z - 1 ? domain + NUM_DOMAINS_X : -1;
+	}
+	return -1;
+}
+
+/*
+* Collects the doneSemaphore post of every worker, checking every DOMAIN_POLL_MS that none of them has exited.
+* A worker that died will never post, and the ones still alive are stuck in the haloBarrier waiting for it.
+*/
+int DomainDecomposition::i_WaitForWorkers()
+{
+	int remaining = NUM_DOMAINS;
+	while (remaining > 0)
+	{
+		struct timespec deadline;
+		clock_gettime(CLOCK_REALTIME, &deadline);
+		deadline.tv_nsec += DOMAIN_POLL_MS*1000000L;
+		deadline.tv_sec += deadline.tv_nsec / 1000000000L;
+		deadline.tv_nsec %= 1000000000L;
+		if (sem_timedwait(&m_control->doneSemaphore, &deadline) == 0)
+		{
+			remaining--;
+			continue;
+		}
+		if (errno != ETIMEDOUT && errno != EINTR)
+			return FAILURE;
+		for (int i = 0; i < m_numWorkers; i++)
+		{
+			if (waitpid(m_workers[i], NULL, WNOHANG) != 0)
+			{
+				printf("The worker for subdomain %d has died\n", i);
+				m_workers[i] = m_workers[--m_numWorkers]; //already reaped
+				return FAILURE;
+			}
+		}
+	}
+	return SUCCESS;
+}
+
+//for when the workers can't be shut down cleanly: they may be blocked anywhere, so they don't get a say
+void DomainDecomposition::i_KillWorkers()
+{
+	for (int i = 0; i < m_numWorkers; i++)
+		kill(m_workers[i], SIGKILL);
+	for (int i = 0; i < m_numWorkers; i++)
+		waitpid(m_workers[i], NULL, 0);
+	m_numWorkers = 0;
+	//not destroyed: a killed worker may have been inside the haloBarrier, and destroying it would wait for that one
+	munmap(m_sharedMemory, m_sharedSize);
+	m_sharedMemory = NULL;
+}
+
+/*
+* The body of a worker process. Each step it evaluates its own vertices, publishes its four edges, waits for
+* its neighbours to do the same and then copies their edges into its halo. The halo is a one vertex ring around
+* the subdomain, laid out so that local[(z + 1)*stride + (x + 1)] is vertex (x0 + x, z0 + z). Corners are not
+* exchanged, and on the outside of the grid the halo repeats the subdomain's own edge.
+* The worker has to keep hitting every barrier even after a failure, or its neighbours would hang.
+*/
+void DomainDecomposition::i_WorkerLoop(int domain, pid_t coordinator)
+{
+	//go down with the coordinator, even if it died before the signal was asked for
+	prctl(PR_SET_PDEATHSIG, SIGKILL);
+	if (getppid() != coordinator)
+		_exit(1);
+
+	stSubdomain* sub = &m_domains[domain];
+	int stride = sub->width + 2;
+	float* local = (float*)malloc(sizeof(float)*stride*(sub->depth + 2));
+	if (!local)
+	{
+		printf("out of memory in the worker for subdomain %d\n", domain);
+		m_control->failed = 1;
+	}
+
+	while (1)
+	{
+		while (sem_wait(&m_control->stepSemaphore) != 0)
+			; //interrupted
+		if (m_control->quit)
+			break;
+		int slot = m_control->step % HALO_SLOTS;
+		int iteration = m_control->iteration;
+
+		if (local)
+		{
+			for (int z = 0; z < sub->depth; z++)
+			{
+				for (int x = 0; x < sub->width; x++)
+					local[(z + 1)*stride + (x + 1)] = m_heightFunction(sub->x0 + x, sub->z0 + z, iteration);
+			}
+			float* west = i_Edge(domain, EDGE_WEST, slot);
+			float* east = i_Edge(domain, EDGE_EAST, slot);
+			for (int z = 0; z < sub->depth; z++)
+			{
+				west[z] = local[(z + 1)*stride + 1];
+				east[z] = local[(z + 1)*stride + sub->width];
+			}
+			memcpy(i_Edge(domain, EDGE_SOUTH, slot), &local[stride + 1], sizeof(float)*sub->width);
+			memcpy(i_Edge(domain, EDGE_NORTH, slot), &local[sub->depth*stride + 1], sizeof(float)*sub->width);
+		}
+		pthread_barrier_wait(&m_control->haloBarrier);
+
+		if (local)
+		{
+			//the edge facing us is always the opposite one (west <-> east, south <-> north)
+			int neighbour = i_Neighbour(domain, EDGE_WEST);
+			float* edge = neighbour < 0 ? i_Edge(domain, EDGE_WEST, slot) : i_Edge(neighbour, EDGE_EAST, slot);
+			for (int z = 0; z < sub->depth; z++)
+				local[(z + 1)*stride] = edge[z];
+			neighbour = i_Neighbour(domain, EDGE_EAST);
+			edge = neighbour < 0 ? i_Edge(domain, EDGE_EAST, slot) : i_Edge(neighbour, EDGE_WEST, slot);
+			for (int z = 0; z < sub->depth; z++)
+				local[(z + 1)*stride + sub->width + 1] = edge[z];
+			neighbour = i_Neighbour(domain, EDGE_SOUTH);
+			edge = neighbour < 0 ? i_Edge(domain, EDGE_SOUTH, slot) : i_Edge(neighbour, EDGE_NORTH, slot);
+			memcpy(&local[1], edge, sizeof(float)*sub->width);
+			neighbour = i_Neighbour(domain, EDGE_NORTH);
+			edge = neighbour < 0 ? i_Edge(domain, EDGE_NORTH, slot) : i_Edge(neighbour, EDGE_SOUTH, slot);
+			memcpy(&local[(sub->depth + 1)*stride + 1], edge, sizeof(float)*sub->width);
+
+			//hand the interior back to the coordinator
+			for (int z = 0; z < sub->depth; z++)
+				memcpy(&m_gather[(sub->z0 + z)*NUM_VERTICES_X + sub->x0], &local[(z + 1)*stride + 1], sizeof(float)*sub->width);
+		}
+		sem_post(&m_control->doneSemaphore);
+	}
+	free(local);
+}
@@ -0,0 +1,85 @@
+#ifndef DOMAIN_DECOMPOSITION_HEADER_INCLUDE
+#define DOMAIN_DECOMPOSITION_HEADER_INCLUDE
+#include "CommonDefines.h"
+#include <sys/types.h>
+#include <pthread.h>
+#include <semaphore.h>
+
+//each published edge has this many slots, and a step writes slot (step % HALO_SLOTS). Step() waits for every
+//worker before it starts the next step, so one slot would do today; the second is only headroom for a
+//coordinator that lets the workers run ahead, where a step could be written while a neighbour still reads the last
+#define HALO_SLOTS 2
+//how often the coordinator looks for dead workers while it waits for a step
+#define DOMAIN_POLL_MS 100
+
+enum
+{
+	EDGE_WEST, //x == 0 of the subdomain
+	EDGE_EAST, //x == width - 1
+	EDGE_SOUTH, //z == 0
+	EDGE_NORTH, //z == depth - 1
+	NUM_EDGES
+};
+
+//the rectangle of the global grid owned by one worker process
+typedef struct
+{
+	int x0, z0; //first vertex owned
+	int width, depth; //number of vertices owned in x and z
+} stSubdomain;
+
+//the part of the shared mapping that the coordinator uses to drive the workers
+typedef struct
+{
+	//the coordinator only ever waits on semaphores, so that it can give up on a worker that died
+	sem_t stepSemaphore; //posted once per worker when a new step has been requested
+	pthread_barrier_t haloBarrier; //workers only: every edge of this step has been published
+	sem_t doneSemaphore; //posted by each worker once its subdomain has been gathered
+	long step; //number of steps requested so far, selects the halo slot
+	int iteration; //passed straight through to the height function
+	int quit; //set by Shutdown() before its final round of stepSemaphore posts
+	int failed; //set by any worker that could not do its work
+} stDomainControl;
+
+/*
+* This class splits the surface into rectangular subdomains and steps each one in its own worker process.
+* The workers only share one anonymous MAP_SHARED mapping with the coordinator, holding the control block,
+* the halo slots that neighbours exchange through every step, and the gather buffer that the coordinator
+* copies back into the vertex array for rendering. Each worker keeps its own subdomain plus a one vertex halo
+* in private memory, so nothing but the edges and the gathered heights ever has to be seen by another process.
+* Init() has to be called before any windowing or OpenGL state exists, because it forks.
+* A worker is killed as soon as the coordinator dies, and a Step() that finds a dead worker kills the rest and
+* fails instead of waiting for it.
+*/
+class DomainDecomposition
+{
+public:
+	DomainDecomposition();
+	~DomainDecomposition();
+	int Init(HeightFunction heightFunction);
+	int Step(int iteration, float* vertexPositions);
+	int Shutdown();
+
+private:
+	//data
+	stSubdomain m_domains[NUM_DOMAINS];
+	pid_t m_workers[NUM_DOMAINS];
+	int m_numWorkers; //number of workers actually forked
+	HeightFunction m_heightFunction;
+	void* m_sharedMemory; //the whole mapping
+	size_t m_sharedSize;
+	stDomainControl* m_control; //these three point into the mapping
+	float* m_halos; //[NUM_DOMAINS][NUM_EDGES][HALO_SLOTS][m_edgeLength]
+	float* m_gather; //[NUM_VERTICES] heights only
+	int m_edgeLength; //longest edge of any subdomain
+
+	//private functions
+	void i_PartitionGrid();
+	float* i_Edge(int domain, int edge, int slot);
+	int i_Neighbour(int domain, int edge);
+	int i_WaitForWorkers();
+	void i_KillWorkers();
+	void i_WorkerLoop(int domain, pid_t coordinator);
+};
+
+#endif //DOMAIN_DECOMPOSITION_HEADER_INCLUDE
@@ -0,0 +1,167 @@
+#include "HeightfieldPublisher.h"
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#define ALIGN_UP(size) (((size) + HEIGHTFIELD_ALIGNMENT - 1) / HEIGHTFIELD_ALIGNMENT * HEIGHTFIELD_ALIGNMENT)
+
+
+HeightfieldPublisher::HeightfieldPublisher() :
+m_name(NULL), m_fd(-1), m_memory(NULL), m_size(0), m_header(NULL)
+{
+}
+
+HeightfieldPublisher::~HeightfieldPublisher()
+{
+}
+
+/*
+function: Init
+Creates the shared memory object and fills in its header. An object left behind by a writer that has died is
+taken over, but one whose writer is still running is left alone.
+Parameters:
+    name: the POSIX shared memory name, normally HEIGHTFIELD_SHM_NAME
+Return Value: SUCCESS, or FAILURE including when another live process is publishing under the name
+*/
+int HeightfieldPublisher::Init(const char* name)
+{
+	size_t headerSize = ALIGN_UP(sizeof(stHeightfieldHeader));
+	size_t slotSize = HEIGHTFIELD_ALIGNMENT + ALIGN_UP(sizeof(float)*NUM_VERTICES);
+	m_size = headerSize + slotSize*HEIGHTFIELD_SLOTS;
+
+	//other local processes only get to read it
+	m_fd = shm_open(name, O_CREAT | O_EXCL | O_RDWR, 0644);
+	if (m_fd < 0 && errno == EEXIST)
+	{
+		m_fd = shm_open(name, O_RDWR, 0644);
+		if (m_fd >= 0 && i_InUse(name))
+		{
+			close(m_fd); m_fd = -1;
+			return FAILURE;
+		}
+	}
+	if (m_fd < 0)
+	{
+		printf("Could not open shared memory %s\n", name);
+		return FAILURE;
+	}
+	if (ftruncate(m_fd, m_size) != 0)
+	{
+		printf("Could not size shared memory %s to %lu bytes\n", name, (unsigned long)m_size);
+		close(m_fd); m_fd = -1;
+		shm_unlink(name);
+		return FAILURE;
+	}
+	m_memory = mmap(NULL, m_size, PROT_READ | PROT_WRITE, MAP_SHARED, m_fd, 0);
+	if (m_memory == MAP_FAILED)
+	{
+		printf("Could not map shared memory %s\n", name);
+		m_memory = NULL;
+		close(m_fd); m_fd = -1;
+		shm_unlink(name);
+		return FAILURE;
+	}
+	m_name = name;
+
+	//a reader left over from an earlier run may still have this mapped, so hide the header until it is rewritten
+	m_header = (stHeightfieldHeader*)m_memory;
+	__atomic_store_n(&m_header->magic, 0, __ATOMIC_RELAXED);
+	memset(m_memory, 0, m_size);
+	m_header->version = HEIGHTFIELD_VERSION;
+	m_header->numVerticesX = NUM_VERTICES_X;
+	m_header->numVerticesZ = NUM_VERTICES_Z;
+	m_header->numSlots = HEIGHTFIELD_SLOTS;
+	m_header->slotSize = slotSize;
+	m_header->headerSize = headerSize;
+	m_header->writerPid = getpid();
+	m_header->latestFrame = 0;
+	__atomic_store_n(&m_header->magic, HEIGHTFIELD_MAGIC, __ATOMIC_RELEASE);
+	return SUCCESS;
+}
+
+/*
+function: Publish
+Writes one frame into the next slot. This never blocks, a reader that is still in the slot will see the sequence
+change under it and retry.
+Parameters:
+    vertexPositions: the interleaved x, y, z array; only the y components are published
+    iteration: stored with the frame
+    stride: the resolution the heights were simulated at, stored with the frame
+Return Value: SUCCESS, or FAILURE if Init() did not succeed
+*/
+int HeightfieldPublisher::Publish(const float* vertexPositions, int iteration, int stride)
+{
+	if (!m_header)
+		return FAILURE;
+	uint64_t frame = m_header->latestFrame + 1;
+	stHeightfieldSlot* slot = (stHeightfieldSlot*)HeightfieldSlot(m_header, frame % HEIGHTFIELD_SLOTS);
+	float* heights = (float*)HeightfieldHeights(slot);
+
+	//odd sequence first, and make sure no reader can see the heights change before it
+	uint64_t sequence = slot->sequence;
+	__atomic_store_n(&slot->sequence, sequence + 1, __ATOMIC_RELAXED);
+	__atomic_thread_fence(__ATOMIC_RELEASE);
+
+	for (long idx = 0; idx < NUM_VERTICES; idx++)
+		heights[idx] = vertexPositions[idx*3 + 1];
+	struct timespec now;
+	clock_gettime(CLOCK_MONOTONIC, &now);
+	slot->frame = frame;
+	slot->timestamp = (uint64_t)now.tv_sec*1000000000 + now.tv_nsec;
+	slot->iteration = iteration;
+	slot->stride = stride;
+
+	__atomic_store_n(&slot->sequence, sequence + 2, __ATOMIC_RELEASE);
+	__atomic_store_n(&m_header->latestFrame, frame, __ATOMIC_RELEASE);
+	return SUCCESS;
+}
+
+//each field is written atomically on its own, so a reader may see one from this frame next to one from the last
+void HeightfieldPublisher::PublishMetrics(int resolutionLevel, double frameBudgetMs, double averageFrameMs)
+{
+	if (!m_header)
+		return;
+	float budget = frameBudgetMs, average = averageFrameMs;
+	__atomic_store_n(&m_header->resolutionLevel, resolutionLevel, __ATOMIC_RELAXED);
+	__atomic_store(&m_header->frameBudgetMs, &budget, __ATOMIC_RELAXED);
+	__atomic_store(&m_header->averageFrameMs, &average, __ATOMIC_RELAXED);
+}
+
+//readers that still have it mapped keep their mapping, the name just goes away
+int HeightfieldPublisher::Deinit()
+{
+	if (m_memory)
+	{
+		munmap(m_memory, m_size);
+		m_memory = NULL;
+		m_header = NULL;
+	}
+	if (m_fd >= 0)
+	{
+		close(m_fd);
+		m_fd = -1;
+		shm_unlink(m_name);
+	}
+	return SUCCESS;
+}
+
+
+
+//whether the existing object on m_fd has a complete header from a writer that is still running
+int HeightfieldPublisher::i_InUse(const char* name)
+{
+	struct stat status;
+	if (fstat(m_fd, &status) != 0 || status.st_size < (off_t)sizeof(stHeightfieldHeader))
+		return 0;
+	const stHeightfieldHeader* header = (const stHeightfieldHeader*)mmap(NULL, sizeof(stHeightfieldHeader), PROT_READ, MAP_SHARED, m_fd, 0);
+	if (header == MAP_FAILED)
+		return 0;
+	int inUse = __atomic_load_n(&header->magic, __ATOMIC_ACQUIRE) == HEIGHTFIELD_MAGIC &&
+		header->writerPid != (uint32_t)getpid() && HeightfieldWriterAlive(header);
+	if (inUse)
+		printf("Shared memory %s is already being published by process %u\n", name, header->writerPid);
+	munmap((void*)header, sizeof(stHeightfieldHeader));
+	return inUse;
+}
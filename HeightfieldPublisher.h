@@ -0,0 +1,35 @@
+#ifndef HEIGHTFIELD_PUBLISHER_HEADER_INCLUDE
+#define HEIGHTFIELD_PUBLISHER_HEADER_INCLUDE
+#include "CommonDefines.h"
+#include "HeightfieldReader.h"
+#include <stddef.h>
+
+#define HEIGHTFIELD_SLOTS 4 //a reader has to fall this many frames behind before the frame it is reading is reused
+
+/*
+* This class is the writing side. Every Publish() copies the heights out of the interleaved vertex array into the
+* next slot of the ring, under the slot's sequence counter, and then moves latestFrame on to it.
+*/
+class HeightfieldPublisher
+{
+public:
+	HeightfieldPublisher();
+	~HeightfieldPublisher();
+	int Init(const char* name);
+	int Publish(const float* vertexPositions, int iteration, int stride);
+	void PublishMetrics(int resolutionLevel, double frameBudgetMs, double averageFrameMs);
+	int Deinit();
+
+private:
+	//data
+	const char* m_name;
+	int m_fd;
+	void* m_memory;
+	size_t m_size;
+	stHeightfieldHeader* m_header;
+
+	//private functions
+	int i_InUse(const char* name);
+};
+
+#endif //HEIGHTFIELD_PUBLISHER_HEADER_INCLUDE
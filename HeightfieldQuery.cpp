@@ -0,0 +1,448 @@
+#include "HeightfieldQuery.h"
+#include <string.h>
+#include <float.h>
+#include <pthread.h>
+
+//one slice of a batched query, for one thread
+typedef struct
+{
+	HeightfieldQuery* query;
+	void* queries; //stHeightQuery* or stRayQuery*
+	int count;
+} stQueryBatch;
+
+//a block of the pyramid still to be looked at by IntersectRay
+typedef struct
+{
+	int level, i, j;
+	float tNear;
+} stQueryNode;
+
+
+HeightfieldQuery::HeightfieldQuery() :
+m_heights(NULL), m_numLevels(0), m_numDirty(0)
+{
+	memset(m_min, 0, sizeof(m_min));
+	memset(m_max, 0, sizeof(m_max));
+}
+
+HeightfieldQuery::~HeightfieldQuery()
+{
+}
+
+/*
+function: Init
+Allocates the height copy and the pyramid. Everything starts out dirty, so the first Rebuild() fills all of it.
+Return Value: SUCCESS or FAILURE
+*/
+int HeightfieldQuery::Init()
+{
+	m_heights = (float*)calloc(NUM_VERTICES, sizeof(float));
+	if (!m_heights)
+	{
+		printf("out of memory\n");
+		return FAILURE;
+	}
+	int width = NUM_VERTICES_X - 1;
+	int depth = NUM_VERTICES_Z - 1;
+	for (m_numLevels = 0; m_numLevels < QUERY_MAX_LEVELS; )
+	{
+		m_min[m_numLevels] = (float*)malloc(sizeof(float)*width*depth);
+		m_max[m_numLevels] = (float*)malloc(sizeof(float)*width*depth);
+		m_levelWidth[m_numLevels] = width;
+		m_levelDepth[m_numLevels] = depth;
+		m_numLevels++;
+		if (!m_min[m_numLevels - 1] || !m_max[m_numLevels - 1])
+		{
+			printf("out of memory\n");
+			Deinit();
+			return FAILURE;
+		}
+		if (width == 1 && depth == 1)
+			break;
+		width = (width + 1) / 2;
+		depth = (depth + 1) / 2;
+	}
+	MarkAllDirty();
+	return SUCCESS;
+}
+
+void HeightfieldQuery::Deinit()
+{
+	for (int level = 0; level < m_numLevels; level++)
+	{
+		free(m_min[level]); m_min[level] = NULL;
+		free(m_max[level]); m_max[level] = NULL;
+	}
+	m_numLevels = 0;
+	free(m_heights); m_heights = NULL;
+}
+
+//the vertices [x0, x1) x [z0, z1) have changed since the last Rebuild()
+void HeightfieldQuery::MarkDirty(long x0, long z0, long x1, long z1)
+{
+	if (m_numDirty == QUERY_MAX_DIRTY_RECTS)
+	{
+		//too scattered to be worth tracking one by one, so fold everything into one rectangle
+		stDirtyRect* merged = &m_dirty[0];
+		for (int i = 1; i < m_numDirty; i++)
+		{
+			if (m_dirty[i].x0 < merged->x0) merged->x0 = m_dirty[i].x0;
+			if (m_dirty[i].z0 < merged->z0) merged->z0 = m_dirty[i].z0;
+			if (m_dirty[i].x1 > merged->x1) merged->x1 = m_dirty[i].x1;
+			if (m_dirty[i].z1 > merged->z1) merged->z1 = m_dirty[i].z1;
+		}
+		if (x0 < merged->x0) merged->x0 = x0;
+		if (z0 < merged->z0) merged->z0 = z0;
+		if (x1 > merged->x1) merged->x1 = x1;
+		if (z1 > merged->z1) merged->z1 = z1;
+		m_numDirty = 1;
+		return;
+	}
+	m_dirty[m_numDirty].x0 = x0;
+	m_dirty[m_numDirty].z0 = z0;
+	m_dirty[m_numDirty].x1 = x1;
+	m_dirty[m_numDirty].z1 = z1;
+	m_numDirty++;
+}
+
+void HeightfieldQuery::MarkAllDirty()
+{
+	m_numDirty = 0;
+	MarkDirty(0, 0, NUM_VERTICES_X, NUM_VERTICES_Z);
+}
+
+/*
+function: Rebuild
+Copies the dirty heights out of the vertex array and refreshes the pyramid above them.
+Parameters:
+    vertexPositions: the interleaved x, y, z array
+*/
+void HeightfieldQuery::Rebuild(const float* vertexPositions)
+{
+	for (int i = 0; i < m_numDirty; i++)
+		i_RebuildRect(vertexPositions, &m_dirty[i]);
+	m_numDirty = 0;
+}
+
+/*
+function: SampleHeight
+Interpolates the height at (x, z) on the same two triangles per cell that IntersectRay() hits, split along the
+diagonal from vertex (i, j) to (i + 1, j + 1). Points off the surface get the height of the nearest edge.
+*/
+float HeightfieldQuery::SampleHeight(float x, float z)
+{
+	float gridX = x*NUM_VERTICES_X;
+	float gridZ = z*NUM_VERTICES_Z;
+	if (gridX < 0.0) gridX = 0.0;
+	if (gridZ < 0.0) gridZ = 0.0;
+	if (gridX > NUM_VERTICES_X - 1) gridX = NUM_VERTICES_X - 1;
+	if (gridZ > NUM_VERTICES_Z - 1) gridZ = NUM_VERTICES_Z - 1;
+	int i = (int)gridX;
+	int j = (int)gridZ;
+	if (i > NUM_VERTICES_X - 2) i = NUM_VERTICES_X - 2;
+	if (j > NUM_VERTICES_Z - 2) j = NUM_VERTICES_Z - 2;
+	float fx = gridX - i;
+	float fz = gridZ - j;
+
+	const float* row = &m_heights[j*NUM_VERTICES_X + i];
+	if (fx >= fz)
+		return row[0] + (row[1] - row[0])*fx + (row[NUM_VERTICES_X + 1] - row[1])*fz;
+	return row[0] + (row[NUM_VERTICES_X] - row[0])*fz + (row[NUM_VERTICES_X + 1] - row[NUM_VERTICES_X])*fx;
+}
+
+int HeightfieldQuery::IsSubmerged(glm::vec3 point)
+{
+	return point.y < SampleHeight(point.x, point.z);
+}
+
+/*
+function: IntersectRay
+Finds the first place a ray hits the surface, treating each cell as two triangles.
+The pyramid is walked from the top, nearest block first, and a block is dropped as soon as the ray misses the
+box between its lowest and highest point, or only reaches it further away than a hit that was already found.
+Parameters:
+    origin, direction: the ray, in the same coordinates as the vertices. direction does not need to be normalized
+    t: set to the distance along the ray, in units of direction, when there is a hit
+Return Value: 1 for a hit, 0 for a miss
+*/
+int HeightfieldQuery::IntersectRay(glm::vec3 origin, glm::vec3 direction, float* t)
+{
+	//work in grid units, where vertex (x, z) sits at (x, height, z). t is unchanged by the scaling
+	float gridOrigin[3] = { origin.x*NUM_VERTICES_X, origin.y, origin.z*NUM_VERTICES_Z };
+	float gridDirection[3] = { direction.x*NUM_VERTICES_X, direction.y, direction.z*NUM_VERTICES_Z };
+
+	float best = FLT_MAX;
+	stQueryNode stack[4*QUERY_MAX_LEVELS];
+	int top = 0;
+	stack[top].level = m_numLevels - 1;
+	stack[top].i = stack[top].j = 0;
+	stack[top].tNear = 0.0;
+	top++;
+
+	while (top > 0)
+	{
+		stQueryNode node = stack[--top];
+		if (node.tNear >= best)
+			continue;
+		if (node.level == 0)
+		{
+			float hit;
+			if (i_IntersectCell(node.i, node.j, gridOrigin, gridDirection, &hit) && hit < best)
+				best = hit;
+			continue;
+		}
+
+		//look at the children, and push them so that the nearest is popped first
+		stQueryNode children[4];
+		int numChildren = 0;
+		int level = node.level - 1;
+		for (int c = 0; c < 4; c++)
+		{
+			int i = node.i*2 + (c & 1);
+			int j = node.j*2 + (c >> 1);
+			if (i >= m_levelWidth[level] || j >= m_levelDepth[level])
+				continue;
+
+			//the block covers cells [i << level, (i + 1) << level), which is the vertices one further
+			float lo[3], hi[3];
+			lo[0] = (float)(i << level);
+			lo[2] = (float)(j << level);
+			hi[0] = (float)((i + 1) << level);
+			hi[2] = (float)((j + 1) << level);
+			if (hi[0] > NUM_VERTICES_X - 1) hi[0] = NUM_VERTICES_X - 1;
+			if (hi[2] > NUM_VERTICES_Z - 1) hi[2] = NUM_VERTICES_Z - 1;
+			lo[1] = m_min[level][j*m_levelWidth[level] + i];
+			hi[1] = m_max[level][j*m_levelWidth[level] + i];
+
+			//slab test against the box
+			float tNear = 0.0, tFar = best;
+			int axis;
+			for (axis = 0; axis < 3; axis++)
+			{
+				if (gridDirection[axis] == 0.0)
+				{
+					if (gridOrigin[axis] < lo[axis] || gridOrigin[axis] > hi[axis])
+						break;
+					continue;
+				}
+				float t0 = (lo[axis] - gridOrigin[axis]) / gridDirection[axis];
+				float t1 = (hi[axis] - gridOrigin[axis]) / gridDirection[axis];
+				if (t0 > t1) { float swap = t0; t0 = t1; t1 = swap; }
+				if (t0 > tNear) tNear = t0;
+				if (t1 < tFar) tFar = t1;
+				if (tNear > tFar)
+					break;
+			}
+			if (axis < 3)
+				continue;
+
+			stQueryNode* child = &children[numChildren++];
+			child->level = level;
+			child->i = i;
+			child->j = j;
+			child->tNear = tNear;
+			//keep the children sorted furthest first
+			for (int k = numChildren - 1; k > 0 && children[k].tNear > children[k - 1].tNear; k--)
+			{
+				stQueryNode swap = children[k];
+				children[k] = children[k - 1];
+				children[k - 1] = swap;
+			}
+		}
+		for (int c = 0; c < numChildren; c++)
+			stack[top++] = children[c];
+	}
+
+	if (best == FLT_MAX)
+		return 0;
+	(*t) = best;
+	return 1;
+}
+
+/*
+function: SampleHeights
+Runs SampleHeight() over a batch, split across up to numThreads threads (the caller being one of them).
+*/
+void HeightfieldQuery::SampleHeights(stHeightQuery* queries, int count, int numThreads)
+{
+	if (numThreads > QUERY_MAX_THREADS) numThreads = QUERY_MAX_THREADS;
+	if (numThreads > count / QUERY_MIN_SAMPLE_BATCH) numThreads = count / QUERY_MIN_SAMPLE_BATCH;
+	if (numThreads < 1) numThreads = 1;
+
+	pthread_t threads[QUERY_MAX_THREADS];
+	stQueryBatch batches[QUERY_MAX_THREADS];
+	int started[QUERY_MAX_THREADS];
+	for (int i = 0; i < numThreads; i++)
+	{
+		int first = (long)count*i / numThreads;
+		batches[i].query = this;
+		batches[i].queries = queries + first;
+		batches[i].count = (long)count*(i + 1) / numThreads - first;
+		//the calling thread takes the first slice, and any slice a thread couldn't be started for
+		started[i] = i > 0 && pthread_create(&threads[i], NULL, i_SampleWorker, &batches[i]) == 0;
+	}
+	for (int i = 0; i < numThreads; i++)
+	{
+		if (!started[i])
+			i_SampleWorker(&batches[i]);
+	}
+	for (int i = 0; i < numThreads; i++)
+	{
+		if (started[i])
+			pthread_join(threads[i], NULL);
+	}
+}
+
+//the same as SampleHeights() for IntersectRay()
+void HeightfieldQuery::IntersectRays(stRayQuery* queries, int count, int numThreads)
+{
+	if (numThreads > QUERY_MAX_THREADS) numThreads = QUERY_MAX_THREADS;
+	if (numThreads > count / QUERY_MIN_RAY_BATCH) numThreads = count / QUERY_MIN_RAY_BATCH;
+	if (numThreads < 1) numThreads = 1;
+
+	pthread_t threads[QUERY_MAX_THREADS];
+	stQueryBatch batches[QUERY_MAX_THREADS];
+	int started[QUERY_MAX_THREADS];
+	for (int i = 0; i < numThreads; i++)
+	{
+		int first = (long)count*i / numThreads;
+		batches[i].query = this;
+		batches[i].queries = queries + first;
+		batches[i].count = (long)count*(i + 1) / numThreads - first;
+		started[i] = i > 0 && pthread_create(&threads[i], NULL, i_RayWorker, &batches[i]) == 0;
+	}
+	for (int i = 0; i < numThreads; i++)
+	{
+		if (!started[i])
+			i_RayWorker(&batches[i]);
+	}
+	for (int i = 0; i < numThreads; i++)
+	{
+		if (started[i])
+			pthread_join(threads[i], NULL);
+	}
+}
+
+
+
+/*
+* Copies one dirty rectangle of heights, then redoes every cell that touches one of its vertices, and every block
+* above those cells. The rectangle of cells halves with each level, so the cost stays close to the size of the rectangle.
+*/
+void HeightfieldQuery::i_RebuildRect(const float* vertexPositions, const stDirtyRect* rect)
+{
+	long x0 = rect->x0 < 0 ? 0 : rect->x0;
+	long z0 = rect->z0 < 0 ? 0 : rect->z0;
+	long x1 = rect->x1 > NUM_VERTICES_X ? NUM_VERTICES_X : rect->x1;
+	long z1 = rect->z1 > NUM_VERTICES_Z ? NUM_VERTICES_Z : rect->z1;
+	if (x0 >= x1 || z0 >= z1)
+		return;
+	for (long z = z0; z < z1; z++)
+	{
+		for (long x = x0; x < x1; x++)
+			m_heights[z*NUM_VERTICES_X + x] = vertexPositions[(z*NUM_VERTICES_X + x)*3 + 1];
+	}
+
+	//cells are inclusive ranges from here on
+	long i0 = x0 > 0 ? x0 - 1 : 0;
+	long j0 = z0 > 0 ? z0 - 1 : 0;
+	long i1 = x1 - 1 < NUM_VERTICES_X - 2 ? x1 - 1 : NUM_VERTICES_X - 2;
+	long j1 = z1 - 1 < NUM_VERTICES_Z - 2 ? z1 - 1 : NUM_VERTICES_Z - 2;
+	for (long j = j0; j <= j1; j++)
+	{
+		for (long i = i0; i <= i1; i++)
+		{
+			const float* row = &m_heights[j*NUM_VERTICES_X + i];
+			float a = row[0], b = row[1], c = row[NUM_VERTICES_X], d = row[NUM_VERTICES_X + 1];
+			long idx = j*m_levelWidth[0] + i;
+			m_min[0][idx] = fminf(fminf(a, b), fminf(c, d));
+			m_max[0][idx] = fmaxf(fmaxf(a, b), fmaxf(c, d));
+		}
+	}
+
+	for (int level = 1; level < m_numLevels; level++)
+	{
+		i0 >>= 1; j0 >>= 1; i1 >>= 1; j1 >>= 1;
+		int below = level - 1;
+		for (long j = j0; j <= j1; j++)
+		{
+			for (long i = i0; i <= i1; i++)
+			{
+				float low = FLT_MAX, high = -FLT_MAX;
+				for (int c = 0; c < 4; c++)
+				{
+					long ci = i*2 + (c & 1);
+					long cj = j*2 + (c >> 1);
+					if (ci >= m_levelWidth[below] || cj >= m_levelDepth[below])
+						continue;
+					long child = cj*m_levelWidth[below] + ci;
+					if (m_min[below][child] < low) low = m_min[below][child];
+					if (m_max[below][child] > high) high = m_max[below][child];
+				}
+				m_min[level][j*m_levelWidth[level] + i] = low;
+				m_max[level][j*m_levelWidth[level] + i] = high;
+			}
+		}
+	}
+}
+
+//Moller-Trumbore against the two triangles of cell (i, j), in grid units
+int HeightfieldQuery::i_IntersectCell(int i, int j, const float* origin, const float* direction, float* t)
+{
+	const float* row = &m_heights[j*NUM_VERTICES_X + i];
+	float corners[4][3] = {
+		{ (float)i, row[0], (float)j },
+		{ (float)(i + 1), row[1], (float)j },
+		{ (float)(i + 1), row[NUM_VERTICES_X + 1], (float)(j + 1) },
+		{ (float)i, row[NUM_VERTICES_X], (float)(j + 1) } };
+	const int triangles[2][3] = { { 0, 1, 2 }, { 0, 2, 3 } };
+
+	int hit = 0;
+	for (int k = 0; k < 2; k++)
+	{
+		const float* v0 = corners[triangles[k][0]];
+		const float* v1 = corners[triangles[k][1]];
+		const float* v2 = corners[triangles[k][2]];
+		float e1[3] = { v1[0] - v0[0], v1[1] - v0[1], v1[2] - v0[2] };
+		float e2[3] = { v2[0] - v0[0], v2[1] - v0[1], v2[2] - v0[2] };
+		float p[3] = { direction[1]*e2[2] - direction[2]*e2[1], direction[2]*e2[0] - direction[0]*e2[2], direction[0]*e2[1] - direction[1]*e2[0] };
+		float determinant = e1[0]*p[0] + e1[1]*p[1] + e1[2]*p[2];
+		if (fabsf(determinant) < 1e-12)
+			continue;
+		float inverse = 1.0 / determinant;
+		float s[3] = { origin[0] - v0[0], origin[1] - v0[1], origin[2] - v0[2] };
+		float u = (s[0]*p[0] + s[1]*p[1] + s[2]*p[2])*inverse;
+		if (u < 0.0 || u > 1.0)
+			continue;
+		float q[3] = { s[1]*e1[2] - s[2]*e1[1], s[2]*e1[0] - s[0]*e1[2], s[0]*e1[1] - s[1]*e1[0] };
+		float v = (direction[0]*q[0] + direction[1]*q[1] + direction[2]*q[2])*inverse;
+		if (v < 0.0 || u + v > 1.0)
+			continue;
+		float distance = (e2[0]*q[0] + e2[1]*q[1] + e2[2]*q[2])*inverse;
+		if (distance >= 0.0 && (!hit || distance < *t))
+		{
+			(*t) = distance;
+			hit = 1;
+		}
+	}
+	return hit;
+}
+
+void* HeightfieldQuery::i_SampleWorker(void* batch)
+{
+	stQueryBatch* slice = (stQueryBatch*)batch;
+	stHeightQuery* queries = (stHeightQuery*)slice->queries;
+	for (int i = 0; i < slice->count; i++)
+		queries[i].height = slice->query->SampleHeight(queries[i].x, queries[i].z);
+	return NULL;
+}
+
+void* HeightfieldQuery::i_RayWorker(void* batch)
+{
+	stQueryBatch* slice = (stQueryBatch*)batch;
+	stRayQuery* queries = (stRayQuery*)slice->queries;
+	for (int i = 0; i < slice->count; i++)
+		queries[i].hit = slice->query->IntersectRay(queries[i].origin, queries[i].direction, &queries[i].t);
+	return NULL;
+}
@@ -0,0 +1,75 @@
+#ifndef HEIGHTFIELD_QUERY_HEADER_INCLUDE
+#define HEIGHTFIELD_QUERY_HEADER_INCLUDE
+#include "CommonDefines.h"
+
+#define QUERY_MAX_LEVELS 32
+#define QUERY_MAX_DIRTY_RECTS 64 //past this many, the dirty rectangles are merged into one
+#define QUERY_MAX_THREADS 16
+//a batch is not split into pieces smaller than these. Starting and joining a thread costs about 20 microseconds,
+//and a slice this size takes over a millisecond (about 50 ns a sample, 2 us a ray), so the start up stays a few
+//percent of each slice. Anything smaller runs on the calling thread alone
+#define QUERY_MIN_SAMPLE_BATCH 32768
+#define QUERY_MIN_RAY_BATCH 512
+
+//coordinates are the same as the vertices: x and z run from 0 to (NUM_VERTICES - 1) / NUM_VERTICES, height is y
+typedef struct
+{
+	float x, z;
+	float height; //filled in
+} stHeightQuery;
+
+typedef struct
+{
+	glm::vec3 origin;
+	glm::vec3 direction;
+	int hit; //filled in
+	float t; //filled in, the hit point is origin + t*direction
+} stRayQuery;
+
+typedef struct
+{
+	long x0, z0, x1, z1; //vertices [x0, x1) x [z0, z1)
+} stDirtyRect;
+
+/*
+* This class answers questions about the surface without scanning it. It keeps its own row major copy of the
+* heights, and a pyramid of the minimum and maximum height over blocks of cells: level 0 has one entry per grid
+* cell (the square between four neighbouring vertices) and every level above halves both dimensions, down to a
+* single entry for the whole surface. Rays skip any block whose bounding box they miss.
+* Rebuild() only redoes the parts of the pyramid above the rectangles passed to MarkDirty() since the last one.
+* The queries only read, so any number of threads can run them at once, but not while Rebuild() is running.
+*/
+class HeightfieldQuery
+{
+public:
+	HeightfieldQuery();
+	~HeightfieldQuery();
+	int Init();
+	void Deinit();
+	void MarkDirty(long x0, long z0, long x1, long z1);
+	void MarkAllDirty();
+	void Rebuild(const float* vertexPositions);
+	float SampleHeight(float x, float z);
+	int IsSubmerged(glm::vec3 point);
+	int IntersectRay(glm::vec3 origin, glm::vec3 direction, float* t);
+	void SampleHeights(stHeightQuery* queries, int count, int numThreads);
+	void IntersectRays(stRayQuery* queries, int count, int numThreads);
+
+private:
+	//data
+	float* m_heights; //[NUM_VERTICES_Z][NUM_VERTICES_X]
+	float* m_min[QUERY_MAX_LEVELS];
+	float* m_max[QUERY_MAX_LEVELS];
+	int m_levelWidth[QUERY_MAX_LEVELS], m_levelDepth[QUERY_MAX_LEVELS];
+	int m_numLevels;
+	stDirtyRect m_dirty[QUERY_MAX_DIRTY_RECTS];
+	int m_numDirty;
+
+	//private functions
+	void i_RebuildRect(const float* vertexPositions, const stDirtyRect* rect);
+	int i_IntersectCell(int i, int j, const float* origin, const float* direction, float* t);
+	static void* i_SampleWorker(void* batch);
+	static void* i_RayWorker(void* batch);
+};
+
+#endif //HEIGHTFIELD_QUERY_HEADER_INCLUDE
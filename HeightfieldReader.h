@@ -0,0 +1,102 @@
+#ifndef HEIGHTFIELD_READER_HEADER_INCLUDE
+#define HEIGHTFIELD_READER_HEADER_INCLUDE
+/*
+* The shared memory format that HeightfieldPublisher writes, and the helpers for reading it. This header stands on
+* its own, so that another local process (in C or C++) can include it without anything else from ripple. A C
+* reader needs _POSIX_C_SOURCE (or _GNU_SOURCE) defined for clock_gettime() and kill().
+*/
+#include <stdint.h>
+#include <time.h>
+#include <errno.h>
+#include <signal.h>
+
+#define HEIGHTFIELD_SHM_NAME "/ripple_heightfield"
+#define HEIGHTFIELD_MAGIC 0x52495050 //"RIPP", written last so a reader knows the header is complete
+#define HEIGHTFIELD_VERSION 4
+#define HEIGHTFIELD_ALIGNMENT 64 //every slot starts on its own cache line
+//a write takes microseconds, so a slot that stays odd this long means the writer stalled or died inside it
+#define HEIGHTFIELD_READ_TIMEOUT_MS 100
+#define HEIGHTFIELD_SPINS_PER_CHECK 1024 //the clock is only read this often while spinning
+
+/*
+* Layout of the shared memory object:
+*   stHeightfieldHeader, padded to HEIGHTFIELD_ALIGNMENT
+*   numSlots times: stHeightfieldSlot, padded to HEIGHTFIELD_ALIGNMENT, then numVerticesX*numVerticesZ floats of
+*   height in row major order (index z*numVerticesX + x), padded so the next slot is aligned too.
+* Everything is found from the header, so a reader doesn't need to be built with the same grid size.
+*/
+typedef struct
+{
+	uint32_t magic;
+	uint32_t version;
+	uint32_t numVerticesX;
+	uint32_t numVerticesZ;
+	uint32_t numSlots;
+	uint32_t slotSize; //bytes from the start of one slot to the next
+	uint32_t headerSize; //bytes from the start of the object to the first slot
+	uint32_t writerPid; //the publishing process, for HeightfieldWriterAlive()
+	uint64_t latestFrame; //the newest complete frame, it lives in slot latestFrame % numSlots. 0 before the first one
+	//how the simulation is keeping up, updated once a frame and all 0 without ADAPTIVE_RESOLUTION
+	uint32_t resolutionLevel; //the surface uses every (1 << resolutionLevel)th vertex
+	float frameBudgetMs;
+	float averageFrameMs;
+	uint32_t reserved;
+} stHeightfieldHeader;
+
+typedef struct
+{
+	uint64_t sequence; //odd while the writer is inside the slot
+	uint64_t frame; //counts up from 1
+	uint64_t timestamp; //CLOCK_MONOTONIC in nanoseconds, taken when the frame was published
+	int32_t iteration; //the simulation iteration the heights belong to
+	uint32_t stride; //only every stride'th vertex in x and z was simulated, the ones in between are interpolated
+} stHeightfieldSlot;
+
+/*
+* Reading a frame, from any process that mapped HEIGHTFIELD_SHM_NAME read only:
+*   const stHeightfieldSlot* slot = HeightfieldSlot(header, header->latestFrame % header->numSlots);
+*   uint64_t sequence;
+*   if (HeightfieldBeginRead(slot, &sequence) != 0) the writer is stuck in the slot, see below
+*   ...use HeightfieldHeights(slot) in place...
+*   if (!HeightfieldEndRead(slot, sequence)) the writer lapped the reader, and whatever was read has to be thrown away
+* The writer never waits for readers, so there is nothing a reader can do to hold up the simulation, and a reader
+* only waits for the writer for up to HEIGHTFIELD_READ_TIMEOUT_MS. When that runs out, HeightfieldWriterAlive()
+* tells a writer that died in the middle of a frame, which will never finish it, from one that is just stalled.
+*/
+static inline const stHeightfieldSlot* HeightfieldSlot(const stHeightfieldHeader* header, uint64_t slot)
+{
+	return (const stHeightfieldSlot*)((const char*)header + header->headerSize + slot*header->slotSize);
+}
+static inline const float* HeightfieldHeights(const stHeightfieldSlot* slot)
+{
+	return (const float*)((const char*)slot + HEIGHTFIELD_ALIGNMENT);
+}
+//0 once the slot is not being written, -1 if the writer stayed inside it for HEIGHTFIELD_READ_TIMEOUT_MS
+static inline int HeightfieldBeginRead(const stHeightfieldSlot* slot, uint64_t* sequence)
+{
+	struct timespec start, now;
+	clock_gettime(CLOCK_MONOTONIC, &start);
+	for (long spins = 1; ((*sequence) = __atomic_load_n(&slot->sequence, __ATOMIC_ACQUIRE)) & 1; spins++)
+	{
+		if (spins % HEIGHTFIELD_SPINS_PER_CHECK)
+			continue;
+		clock_gettime(CLOCK_MONOTONIC, &now);
+		if ((now.tv_sec - start.tv_sec)*1000 + (now.tv_nsec - start.tv_nsec) / 1000000 >= HEIGHTFIELD_READ_TIMEOUT_MS)
+			return -1;
+	}
+	return 0;
+}
+//1 if nothing was written into the slot since HeightfieldBeginRead(), 0 otherwise
+static inline int HeightfieldEndRead(const stHeightfieldSlot* slot, uint64_t sequence)
+{
+	__atomic_thread_fence(__ATOMIC_ACQUIRE);
+	return __atomic_load_n(&slot->sequence, __ATOMIC_RELAXED) == sequence;
+}
+//EPERM still means there is a process with that pid, it just belongs to someone else. A pid of 0 would ask
+//about our own process group, and only shows up in a header that was never completed
+static inline int HeightfieldWriterAlive(const stHeightfieldHeader* header)
+{
+	return header->writerPid != 0 && (kill((pid_t)header->writerPid, 0) == 0 || errno == EPERM);
+}
+
+#endif //HEIGHTFIELD_READER_HEADER_INCLUDE
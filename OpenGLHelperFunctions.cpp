@@ -1,4 +1,6 @@
 #include "OpenGLHelperFunctions.h"
+#include <string.h>
+#include <pthread.h>
 
 
 MatrixSet::MatrixSet() :
@@ -242,21 +244,21 @@ GLint MakeShaderProgram(const char* vertFileName, const char* geoFileName, const
     GLint programID = glCreateProgram();
 
     //compile each of the shaders that isn't null
-    if (vertFileName != '\0')
+    if (vertFileName != NULL)
     {
         GLuint vertShader = CompileShader(GL_VERTEX_SHADER, vertFileName, debugOption);
         if (vertShader == 0)
             return 0;
         glAttachShader(programID, vertShader);
     }
-    if (geoFileName != '\0')
+    if (geoFileName != NULL)
     {
         GLuint geoShader = CompileShader(GL_GEOMETRY_SHADER, geoFileName, debugOption);
         if (geoShader == 0)
             return 0;
         glAttachShader(programID, geoShader);
     }
-    if (fragFileName != '\0')
+    if (fragFileName != NULL)
     {
         GLuint fragShader = CompileShader(GL_FRAGMENT_SHADER, fragFileName, debugOption);
         if (fragShader == 0)
@@ -303,3 +305,232 @@ GLint MakeShaderProgram(const char* vertFileName, const char* geoFileName, const
     return programID;
 }
 
+
+#ifdef OPENGL_DEBUG
+
+typedef struct
+{
+    GLenum source;
+    GLenum type;
+    GLenum severity;
+    GLuint id;
+    char text[256];
+} stDebugMessage;
+
+//the callback can come from a driver thread, so the queue is shared and locked
+static stDebugMessage s_debugQueue[OPENGL_DEBUG_QUEUE_LENGTH];
+static int s_debugQueued = 0;
+static int s_debugDropped = 0;
+static pthread_mutex_t s_debugLock = PTHREAD_MUTEX_INITIALIZER;
+static int s_debugAvailable = 0; //KHR_debug was found, so nothing needs glGetError
+
+static void GLAPIENTRY DebugMessageCallback(GLenum source, GLenum type, GLuint id, GLenum severity,
+    GLsizei length, const GLchar* message, const void* userParam)
+{
+    pthread_mutex_lock(&s_debugLock);
+    if (s_debugQueued == OPENGL_DEBUG_QUEUE_LENGTH)
+    {
+        s_debugDropped++;
+    }
+    else
+    {
+        stDebugMessage* queued = &s_debugQueue[s_debugQueued++];
+        queued->source = source;
+        queued->type = type;
+        queued->severity = severity;
+        queued->id = id;
+        snprintf(queued->text, sizeof(queued->text), "%s", message);
+    }
+    pthread_mutex_unlock(&s_debugLock);
+}
+
+static const char* DebugSourceString(GLenum source)
+{
+    switch (source)
+    {
+        case GL_DEBUG_SOURCE_API: return "api";
+        case GL_DEBUG_SOURCE_WINDOW_SYSTEM: return "window system";
+        case GL_DEBUG_SOURCE_SHADER_COMPILER: return "shader compiler";
+        case GL_DEBUG_SOURCE_THIRD_PARTY: return "third party";
+        case GL_DEBUG_SOURCE_APPLICATION: return "application";
+        default: return "other";
+    }
+}
+static const char* DebugTypeString(GLenum type)
+{
+    switch (type)
+    {
+        case GL_DEBUG_TYPE_ERROR: return "error";
+        case GL_DEBUG_TYPE_DEPRECATED_BEHAVIOR: return "deprecated";
+        case GL_DEBUG_TYPE_UNDEFINED_BEHAVIOR: return "undefined behaviour";
+        case GL_DEBUG_TYPE_PORTABILITY: return "portability";
+        case GL_DEBUG_TYPE_PERFORMANCE: return "performance";
+        case GL_DEBUG_TYPE_MARKER: return "marker";
+        case GL_DEBUG_TYPE_PUSH_GROUP: return "push group";
+        case GL_DEBUG_TYPE_POP_GROUP: return "pop group";
+        default: return "other";
+    }
+}
+static const char* DebugSeverityString(GLenum severity)
+{
+    switch (severity)
+    {
+        case GL_DEBUG_SEVERITY_HIGH: return "high";
+        case GL_DEBUG_SEVERITY_MEDIUM: return "medium";
+        case GL_DEBUG_SEVERITY_LOW: return "low";
+        default: return "notification";
+    }
+}
+
+/*
+function: OGLDebugInit
+Turns on debug output, and lets through only the messages at least as severe as minimumSeverity.
+Debug output is left asynchronous, so the driver is never made to finish its work to report a message.
+It needs a context created with SDL_GL_CONTEXT_DEBUG_FLAG to report much of anything.
+Parameters:
+    minimumSeverity: GL_DEBUG_SEVERITY_HIGH | GL_DEBUG_SEVERITY_MEDIUM | GL_DEBUG_SEVERITY_LOW | GL_DEBUG_SEVERITY_NOTIFICATION
+Return Value: SUCCESS, even without KHR_debug, in which case OGL_DEBUG_CHECK falls back to glGetError
+*/
+int OGLDebugInit(GLenum minimumSeverity)
+{
+    s_debugAvailable = GLEW_KHR_debug || GLEW_VERSION_4_3;
+    if (!s_debugAvailable)
+    {
+        printf("KHR_debug is not available, falling back to glGetError\n");
+        return SUCCESS;
+    }
+    glEnable(GL_DEBUG_OUTPUT);
+    glDebugMessageCallback(DebugMessageCallback, NULL);
+
+    //the severities from most to least severe, everything after minimumSeverity is switched off
+    const GLenum severities[] = { GL_DEBUG_SEVERITY_HIGH, GL_DEBUG_SEVERITY_MEDIUM, GL_DEBUG_SEVERITY_LOW, GL_DEBUG_SEVERITY_NOTIFICATION };
+    GLboolean enabled = GL_TRUE;
+    for (int i = 0; i < 4; i++)
+    {
+        glDebugMessageControl(GL_DONT_CARE, GL_DONT_CARE, severities[i], 0, NULL, enabled);
+        if (severities[i] == minimumSeverity)
+            enabled = GL_FALSE;
+    }
+    return SUCCESS;
+}
+
+/* prints everything the driver has reported since the last flush. Called once a frame from the main thread */
+void OGLDebugFlush()
+{
+    stDebugMessage messages[OPENGL_DEBUG_QUEUE_LENGTH];
+    pthread_mutex_lock(&s_debugLock);
+    int count = s_debugQueued;
+    int dropped = s_debugDropped;
+    memcpy(messages, s_debugQueue, sizeof(stDebugMessage)*count);
+    s_debugQueued = 0;
+    s_debugDropped = 0;
+    pthread_mutex_unlock(&s_debugLock);
+
+    for (int i = 0; i < count; i++)
+    {
+        printf("GL %s from %s (severity %s, id %u): %s\n", DebugTypeString(messages[i].type),
+            DebugSourceString(messages[i].source), DebugSeverityString(messages[i].severity),
+            messages[i].id, messages[i].text);
+    }
+    if (dropped)
+        printf("GL debug: %d more messages were dropped\n", dropped);
+}
+
+void OGLDebugPushGroup(const char* name)
+{
+    if (s_debugAvailable)
+        glPushDebugGroup(GL_DEBUG_SOURCE_APPLICATION, 0, -1, name);
+}
+void OGLDebugPopGroup()
+{
+    if (s_debugAvailable)
+        glPopDebugGroup();
+}
+
+/* identifier: GL_BUFFER | GL_PROGRAM | GL_SHADER | GL_TEXTURE etc. name: the object */
+void OGLDebugLabel(GLenum identifier, GLuint name, const char* label)
+{
+    if (s_debugAvailable)
+        glObjectLabel(identifier, name, -1, label);
+}
+
+/* the old synchronous check, only used when the driver can't report errors by itself */
+void OGLDebugCheck(int lineNumber)
+{
+    if (!s_debugAvailable)
+        OGLErrorCheck(lineNumber);
+}
+#endif //OPENGL_DEBUG
+
+
+
+GpuTimer::GpuTimer() :
+m_next(0), m_available(0), m_latest(0.0)
+{
+	for (int i = 0; i < GPU_TIMER_QUERIES; i++)
+	{
+		m_queries[i] = 0;
+		m_pending[i] = 0;
+	}
+}
+
+GpuTimer::~GpuTimer()
+{
+}
+
+//needs the context, and succeeds without the extension too, since the timer is only a hint
+int GpuTimer::Init()
+{
+	m_available = GLEW_ARB_timer_query || GLEW_VERSION_3_3;
+	if (!m_available)
+	{
+		printf("GL_TIME_ELAPSED queries are not available, the GPU time is not measured\n");
+		return SUCCESS;
+	}
+	glGenQueries(GPU_TIMER_QUERIES, m_queries);
+	return SUCCESS;
+}
+
+void GpuTimer::Deinit()
+{
+	if (m_available)
+		glDeleteQueries(GPU_TIMER_QUERIES, m_queries);
+	m_available = 0;
+}
+
+void GpuTimer::Begin()
+{
+	if (m_available)
+		glBeginQuery(GL_TIME_ELAPSED, m_queries[m_next]);
+}
+
+void GpuTimer::End()
+{
+	if (!m_available)
+		return;
+	glEndQuery(GL_TIME_ELAPSED);
+	m_pending[m_next] = 1;
+	m_next = (m_next + 1) % GPU_TIMER_QUERIES;
+}
+
+/*
+function: Collect
+Reads back the oldest measurement if the GPU has finished it. Call it once a frame, after End().
+Return Value: the GPU time of the newest measurement read so far, in milliseconds
+*/
+double GpuTimer::Collect()
+{
+	if (!m_available || !m_pending[m_next])
+		return m_latest;
+	GLint ready = 0;
+	glGetQueryObjectiv(m_queries[m_next], GL_QUERY_RESULT_AVAILABLE, &ready);
+	if (ready)
+	{
+		GLuint64 nanoseconds = 0;
+		glGetQueryObjectui64v(m_queries[m_next], GL_QUERY_RESULT, &nanoseconds);
+		m_latest = nanoseconds / 1000000.0;
+	}
+	//either way Begin() is about to reuse the query, which drops a result that wasn't ready
+	m_pending[m_next] = 0;
+	return m_latest;
+}
@@ -47,9 +47,66 @@ private:
 	void i_RefreshPerspective();
 };
 
+#define GPU_TIMER_QUERIES 3 //a measurement is read back this many frames after it was taken
+
+/*
+* This class measures how long the GPU spends on a stretch of commands, with GL_TIME_ELAPSED queries.
+* Begin() and End() go around the commands once a frame, each frame in the next of a ring of queries, and
+* Collect() picks up the result of the oldest one just before its query is used again. By then the GPU has
+* normally finished it, and if it hasn't the result is skipped rather than waited for, so the pipeline never
+* stalls. Without ARB_timer_query (GL 3.3) it does nothing, and Collect() stays at 0.
+*/
+class GpuTimer
+{
+public:
+	GpuTimer();
+	~GpuTimer();
+	int Init();
+	void Deinit();
+	void Begin();
+	void End();
+	double Collect();
+
+private:
+	//data
+	GLuint m_queries[GPU_TIMER_QUERIES];
+	int m_pending[GPU_TIMER_QUERIES]; //ended, and the result not read yet
+	int m_next; //the query the next Begin() uses
+	int m_available;
+	double m_latest; //milliseconds, from the newest measurement read back
+};
+
 //other opengl helper functions
 int OGLErrorCheck(int lineNumber);
 GLuint CompileShader(GLenum eShaderType, const char* filename, int debugOption);
 GLint MakeShaderProgram(const char* vertFileName, const char* geoFileName, const char* fragFileName, int debugOption);
 
+/*
+* Debug output. The driver reports problems through glDebugMessageCallback instead of being asked with
+* glGetError, which would stall the pipeline, and the messages are queued and only printed by OGL_DEBUG_FLUSH,
+* once a frame. Groups and labels make the messages (and any GL debugger) show which stage and object they are
+* about. Everything is behind these macros so that it compiles away completely without OPENGL_DEBUG.
+*/
+#ifdef OPENGL_DEBUG
+int OGLDebugInit(GLenum minimumSeverity);
+void OGLDebugFlush();
+void OGLDebugPushGroup(const char* name);
+void OGLDebugPopGroup();
+void OGLDebugLabel(GLenum identifier, GLuint name, const char* label);
+void OGLDebugCheck(int lineNumber);
+#define OGL_DEBUG_INIT(minimumSeverity) OGLDebugInit(minimumSeverity)
+#define OGL_DEBUG_FLUSH() OGLDebugFlush()
+#define OGL_DEBUG_PUSH_GROUP(name) OGLDebugPushGroup(name)
+#define OGL_DEBUG_POP_GROUP() OGLDebugPopGroup()
+#define OGL_DEBUG_LABEL(identifier, name, label) OGLDebugLabel(identifier, name, label)
+#define OGL_DEBUG_CHECK() OGLDebugCheck(__LINE__)
+#else
+#define OGL_DEBUG_INIT(minimumSeverity) SUCCESS
+#define OGL_DEBUG_FLUSH() ((void)0)
+#define OGL_DEBUG_PUSH_GROUP(name) ((void)0)
+#define OGL_DEBUG_POP_GROUP() ((void)0)
+#define OGL_DEBUG_LABEL(identifier, name, label) ((void)0)
+#define OGL_DEBUG_CHECK() ((void)0)
+#endif //OPENGL_DEBUG
+
 #endif //OPENGL_HELPER_HEADER_INCLUDE
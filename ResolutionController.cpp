@@ -0,0 +1,114 @@
+#include "ResolutionController.h"
+
+
+ResolutionController::ResolutionController() :
+m_budget(FRAME_BUDGET_FRACTION*1000.0 / DEFAULT_REFRESH_RATE), m_average(0.0), m_haveAverage(0), m_level(0), m_slowFrames(0), m_fastFrames(0), m_cooldown(0)
+{
+	for (int stage = 0; stage < NUM_STAGES; stage++)
+		m_stageStart[stage] = m_stageTime[stage] = 0.0;
+}
+
+ResolutionController::~ResolutionController()
+{
+}
+
+void ResolutionController::Init(double budgetMs)
+{
+	m_budget = budgetMs;
+	m_haveAverage = 0;
+	m_slowFrames = m_fastFrames = m_cooldown = 0;
+	m_level = 0;
+}
+
+void ResolutionController::BeginStage(int stage)
+{
+	m_stageStart[stage] = i_Now();
+}
+void ResolutionController::EndStage(int stage)
+{
+	m_stageTime[stage] += i_Now() - m_stageStart[stage];
+}
+void ResolutionController::AddStageTime(int stage, double milliseconds)
+{
+	m_stageTime[stage] += milliseconds;
+}
+
+/*
+function: EndFrame
+Takes in the stage times of the frame that just finished, and decides whether the level should change.
+Return Value: 1 if the level changed, 0 otherwise
+*/
+int ResolutionController::EndFrame()
+{
+	double frameTime = 0.0;
+	for (int stage = 0; stage < NUM_STAGES; stage++)
+	{
+		frameTime += m_stageTime[stage];
+		m_stageTime[stage] = 0.0;
+	}
+	if (m_haveAverage)
+		m_average += RESOLUTION_SMOOTHING*(frameTime - m_average);
+	else
+		m_average = frameTime;
+	m_haveAverage = 1;
+
+	if (m_cooldown > 0)
+	{
+		m_cooldown--;
+		return 0;
+	}
+
+	m_slowFrames = m_average > m_budget*RESOLUTION_DEGRADE_RATIO ? m_slowFrames + 1 : 0;
+	m_fastFrames = m_average < m_budget*RESOLUTION_IMPROVE_RATIO ? m_fastFrames + 1 : 0;
+	if (m_slowFrames >= RESOLUTION_DEGRADE_FRAMES && m_level < RESOLUTION_LEVELS - 1)
+	{
+		i_SetLevel(m_level + 1);
+		return 1;
+	}
+	if (m_fastFrames >= RESOLUTION_IMPROVE_FRAMES && m_level > 0)
+	{
+		i_SetLevel(m_level - 1);
+		return 1;
+	}
+	return 0;
+}
+
+int ResolutionController::GetLevel()
+{
+	return m_level;
+}
+
+int ResolutionController::GetStride()
+{
+	return 1 << m_level;
+}
+
+//milliseconds
+double ResolutionController::GetAverageFrameTime()
+{
+	return m_average;
+}
+
+double ResolutionController::GetBudget()
+{
+	return m_budget;
+}
+
+
+
+double ResolutionController::i_Now()
+{
+	struct timespec now;
+	clock_gettime(CLOCK_MONOTONIC, &now);
+	return now.tv_sec*1000.0 + now.tv_nsec / 1000000.0;
+}
+
+//the old average says nothing about the new level, so it is measured again from scratch
+void ResolutionController::i_SetLevel(int level)
+{
+	printf("resolution level %d (stride %d): %.2f ms average against a %.2f ms budget\n", level, 1 << level, m_average, m_budget);
+	m_level = level;
+	m_haveAverage = 0;
+	m_slowFrames = m_fastFrames = 0;
+	m_cooldown = RESOLUTION_COOLDOWN_FRAMES;
+}
@@ -0,0 +1,60 @@
+#ifndef RESOLUTION_CONTROLLER_HEADER_INCLUDE
+#define RESOLUTION_CONTROLLER_HEADER_INCLUDE
+#include "CommonDefines.h"
+
+#define RESOLUTION_SMOOTHING 0.2 //weight of the newest frame in the running average
+#define RESOLUTION_DEGRADE_RATIO 1.0 //over this fraction of the budget counts as a slow frame
+#define RESOLUTION_DEGRADE_FRAMES 3 //slow frames in a row before going coarser
+//a level finer costs about four times as much, so only go back when that would still leave some room
+#define RESOLUTION_IMPROVE_RATIO 0.2
+#define RESOLUTION_IMPROVE_FRAMES 30 //fast frames in a row before going finer
+#define RESOLUTION_COOLDOWN_FRAMES 10 //frames after a change that are measured but not acted on
+
+enum
+{
+	STAGE_UPDATE,
+	STAGE_RENDER, //submitting the draw calls on the CPU
+	STAGE_GPU, //the GPU running them, measured elsewhere and handed in with AddStageTime()
+	NUM_STAGES
+};
+
+/*
+* This class keeps the frame time inside a budget by changing the resolution of the surface.
+* Each frame the CPU stages are timed with BeginStage()/EndStage(), the GPU time is added with AddStageTime(), and
+* EndFrame() folds their total into a running
+* average. The level only changes when the average has been over the budget (or well under it) for several frames
+* in a row, and after a change the controller waits out a cooldown before deciding again, so that it settles
+* instead of going back and forth. Level n works on every (1 << n)th vertex in each direction.
+*/
+class ResolutionController
+{
+public:
+	ResolutionController();
+	~ResolutionController();
+	void Init(double budgetMs);
+	void BeginStage(int stage);
+	void EndStage(int stage);
+	void AddStageTime(int stage, double milliseconds);
+	int EndFrame();
+	int GetLevel();
+	int GetStride();
+	double GetAverageFrameTime();
+	double GetBudget();
+
+private:
+	//data
+	double m_budget; //milliseconds
+	double m_stageStart[NUM_STAGES];
+	double m_stageTime[NUM_STAGES]; //milliseconds this frame
+	double m_average;
+	int m_haveAverage;
+	int m_level;
+	int m_slowFrames, m_fastFrames;
+	int m_cooldown;
+
+	//private functions
+	static double i_Now();
+	void i_SetLevel(int level);
+};
+
+#endif //RESOLUTION_CONTROLLER_HEADER_INCLUDE
@@ -0,0 +1,200 @@
+#include "TaskGraph.h"
+
+
+TaskGraph::TaskGraph() :
+m_tasks(NULL), m_edges(NULL), m_numTasks(0), m_maxTasks(0), m_numEdges(0), m_maxEdges(0),
+m_workerQueue(NULL), m_mainQueue(NULL), m_workerHead(0), m_workerTail(0), m_mainHead(0), m_mainTail(0),
+m_unfinished(0), m_quit(0), m_numThreads(0)
+{
+}
+
+TaskGraph::~TaskGraph()
+{
+}
+
+/*
+function: Init
+Allocates room for the graph and starts the worker threads.
+Parameters:
+    maxTasks: the most tasks that will be added
+    maxDependencies: the most calls to AddDependency() that will be made
+    numWorkers: threads to start, up to MAX_WORKER_THREADS. With 0, Run() does all of the work itself
+Return Value: SUCCESS or FAILURE
+*/
+int TaskGraph::Init(int maxTasks, int maxDependencies, int numWorkers)
+{
+	m_tasks = (stTask*)malloc(sizeof(stTask)*maxTasks);
+	m_edges = (stEdge*)malloc(sizeof(stEdge)*maxDependencies);
+	m_workerQueue = (int*)malloc(sizeof(int)*maxTasks);
+	m_mainQueue = (int*)malloc(sizeof(int)*maxTasks);
+	if (!m_tasks || !m_edges || !m_workerQueue || !m_mainQueue)
+	{
+		printf("out of memory\n");
+		free(m_tasks); m_tasks = NULL;
+		free(m_edges); m_edges = NULL;
+		free(m_workerQueue); m_workerQueue = NULL;
+		free(m_mainQueue); m_mainQueue = NULL;
+		return FAILURE;
+	}
+	m_maxTasks = maxTasks;
+	m_maxEdges = maxDependencies;
+	m_numTasks = m_numEdges = 0;
+	m_quit = 0;
+
+	pthread_mutex_init(&m_lock, NULL);
+	pthread_cond_init(&m_workerReady, NULL);
+	pthread_cond_init(&m_mainReady, NULL);
+	if (numWorkers > MAX_WORKER_THREADS) numWorkers = MAX_WORKER_THREADS;
+	for (m_numThreads = 0; m_numThreads < numWorkers; m_numThreads++)
+	{
+		if (pthread_create(&m_threads[m_numThreads], NULL, i_WorkerMain, this) != 0)
+		{
+			//carry on with the ones that did start, the main thread picks up the slack
+			printf("Could only start %d of %d worker threads\n", m_numThreads, numWorkers);
+			break;
+		}
+	}
+	return SUCCESS;
+}
+
+void TaskGraph::Shutdown()
+{
+	if (m_numThreads)
+	{
+		pthread_mutex_lock(&m_lock);
+		m_quit = 1;
+		pthread_cond_broadcast(&m_workerReady);
+		pthread_mutex_unlock(&m_lock);
+		for (int i = 0; i < m_numThreads; i++)
+			pthread_join(m_threads[i], NULL);
+		m_numThreads = 0;
+	}
+	if (m_tasks)
+	{
+		pthread_cond_destroy(&m_workerReady);
+		pthread_cond_destroy(&m_mainReady);
+		pthread_mutex_destroy(&m_lock);
+	}
+	free(m_tasks); m_tasks = NULL;
+	free(m_edges); m_edges = NULL;
+	free(m_workerQueue); m_workerQueue = NULL;
+	free(m_mainQueue); m_mainQueue = NULL;
+}
+
+//returns the id of the new task, or -1 when the graph is full
+int TaskGraph::AddTask(TaskFunction function, void* data, int index, int affinity)
+{
+	if (m_numTasks == m_maxTasks)
+		return -1;
+	stTask* task = &m_tasks[m_numTasks];
+	task->function = function;
+	task->data = data;
+	task->index = index;
+	task->affinity = affinity;
+	task->numDependencies = 0;
+	task->remaining = 0;
+	task->firstSuccessor = -1;
+	return m_numTasks++;
+}
+
+//after will not start in a run until before has finished
+int TaskGraph::AddDependency(int before, int after)
+{
+	if (m_numEdges == m_maxEdges || before < 0 || after < 0)
+		return FAILURE;
+	m_edges[m_numEdges].task = after;
+	m_edges[m_numEdges].next = m_tasks[before].firstSuccessor;
+	m_tasks[before].firstSuccessor = m_numEdges++;
+	m_tasks[after].numDependencies++;
+	return SUCCESS;
+}
+
+/*
+function: Run
+Runs every task in the graph once, in dependency order. This has to be called from the thread that owns the
+OpenGL context. It runs the TASK_MAIN_THREAD tasks as they become ready, and helps with the TASK_ANY_THREAD
+tasks whenever none of its own are waiting.
+*/
+void TaskGraph::Run()
+{
+	pthread_mutex_lock(&m_lock);
+	m_workerHead = m_workerTail = m_mainHead = m_mainTail = 0;
+	m_unfinished = m_numTasks;
+	for (int i = 0; i < m_numTasks; i++)
+		m_tasks[i].remaining = m_tasks[i].numDependencies;
+	for (int i = 0; i < m_numTasks; i++)
+	{
+		if (m_tasks[i].numDependencies == 0)
+			i_Queue(i);
+	}
+
+	while (m_unfinished > 0)
+	{
+		int task;
+		if (m_mainHead < m_mainTail)
+			task = m_mainQueue[m_mainHead++];
+		else if (m_workerHead < m_workerTail)
+			task = m_workerQueue[m_workerHead++];
+		else
+		{
+			pthread_cond_wait(&m_mainReady, &m_lock);
+			continue;
+		}
+		pthread_mutex_unlock(&m_lock);
+		m_tasks[task].function(m_tasks[task].data, m_tasks[task].index);
+		pthread_mutex_lock(&m_lock);
+		i_Finish(task);
+	}
+	pthread_mutex_unlock(&m_lock);
+}
+
+
+
+//both of these are called with m_lock held
+void TaskGraph::i_Queue(int task)
+{
+	if (m_tasks[task].affinity == TASK_MAIN_THREAD)
+	{
+		m_mainQueue[m_mainTail++] = task;
+		pthread_cond_signal(&m_mainReady);
+	}
+	else
+	{
+		m_workerQueue[m_workerTail++] = task;
+		pthread_cond_signal(&m_workerReady);
+		//the main thread may be idle, and can take it as well
+		pthread_cond_signal(&m_mainReady);
+	}
+}
+void TaskGraph::i_Finish(int task)
+{
+	for (int edge = m_tasks[task].firstSuccessor; edge >= 0; edge = m_edges[edge].next)
+	{
+		int successor = m_edges[edge].task;
+		if (--m_tasks[successor].remaining == 0)
+			i_Queue(successor);
+	}
+	m_unfinished--;
+	if (m_unfinished == 0)
+		pthread_cond_signal(&m_mainReady);
+}
+
+void* TaskGraph::i_WorkerMain(void* graph)
+{
+	TaskGraph* self = (TaskGraph*)graph;
+	pthread_mutex_lock(&self->m_lock);
+	while (1)
+	{
+		while (!self->m_quit && self->m_workerHead == self->m_workerTail)
+			pthread_cond_wait(&self->m_workerReady, &self->m_lock);
+		if (self->m_quit)
+			break;
+		int task = self->m_workerQueue[self->m_workerHead++];
+		pthread_mutex_unlock(&self->m_lock);
+		self->m_tasks[task].function(self->m_tasks[task].data, self->m_tasks[task].index);
+		pthread_mutex_lock(&self->m_lock);
+		self->i_Finish(task);
+	}
+	pthread_mutex_unlock(&self->m_lock);
+	return NULL;
+}
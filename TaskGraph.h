@@ -0,0 +1,76 @@
+#ifndef TASK_GRAPH_HEADER_INCLUDE
+#define TASK_GRAPH_HEADER_INCLUDE
+#include "CommonDefines.h"
+#include <pthread.h>
+
+#define MAX_WORKER_THREADS 16
+
+//where a task is allowed to run
+enum
+{
+	TASK_ANY_THREAD, //a worker thread, or the main thread when it has nothing else to do
+	TASK_MAIN_THREAD //only the thread that calls Run(), which is the one holding the OpenGL context
+};
+
+typedef void (*TaskFunction)(void* data, int index);
+
+typedef struct
+{
+	TaskFunction function;
+	void* data;
+	int index; //passed to the function, so one function can serve a task per tile
+	int affinity;
+	int numDependencies;
+	int remaining; //dependencies still to finish in the current run
+	int firstSuccessor; //head of this task's list in m_edges, -1 if there are none
+} stTask;
+
+typedef struct
+{
+	int task;
+	int next; //next edge from the same task, -1 at the end
+} stEdge;
+
+/*
+* This class runs a fixed graph of tasks once per frame. The graph is built once with AddTask() and AddDependency(),
+* and every Run() releases the tasks with no dependencies and then hands each task to a queue as soon as the last
+* of its dependencies finishes. TASK_ANY_THREAD tasks go to the worker threads, TASK_MAIN_THREAD tasks are run by
+* the caller of Run(), so OpenGL calls can start on the first finished pieces of work while the rest are still
+* being computed. Run() returns once every task has finished.
+*/
+class TaskGraph
+{
+public:
+	TaskGraph();
+	~TaskGraph();
+	int Init(int maxTasks, int maxDependencies, int numWorkers);
+	void Shutdown();
+	int AddTask(TaskFunction function, void* data, int index, int affinity);
+	int AddDependency(int before, int after);
+	void Run();
+
+private:
+	//data
+	stTask* m_tasks;
+	stEdge* m_edges;
+	int m_numTasks, m_maxTasks;
+	int m_numEdges, m_maxEdges;
+	int* m_workerQueue; //each task is queued at most once per run, so these never need to wrap
+	int* m_mainQueue;
+	int m_workerHead, m_workerTail;
+	int m_mainHead, m_mainTail;
+	int m_unfinished; //tasks left in the current run
+	int m_quit;
+	pthread_mutex_t m_lock; //guards everything above apart from the fixed parts of the graph
+	pthread_cond_t m_workerReady;
+	pthread_cond_t m_mainReady;
+	pthread_t m_threads[MAX_WORKER_THREADS];
+	int m_numThreads;
+
+	//private functions
+	void i_Queue(int task);
+	void i_Finish(int task);
+	static void* i_WorkerMain(void* graph);
+};
+
+#endif //TASK_GRAPH_HEADER_INCLUDE
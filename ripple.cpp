@@ -1,5 +1,15 @@
 #include "ripple.h"
 #include "OpenGLHelperFunctions.h"
+#include "DomainDecomposition.h"
+#include "ActiveRegions.h"
+#include "TaskGraph.h"
+#include "HeightfieldPublisher.h"
+#include "HeightfieldQuery.h"
+#include "ResolutionController.h"
+
+#if defined(TILE_TASK_GRAPH) && (!defined(ACTIVE_REGIONS) || defined(DOMAIN_DECOMPOSITION))
+#error TILE_TASK_GRAPH computes the ACTIVE_REGIONS tiles in this process, so it needs ACTIVE_REGIONS and not DOMAIN_DECOMPOSITION
+#endif
 
 /*Project Purpose:
 * This will be a shot of a surface that bounces up and down in a sine wave propogating outwards in a ripple fashion
@@ -10,6 +20,14 @@
 #define OPENGL_GEOMETRY_SHADER 0
 #define OPENGL_FRAGMENT_SHADER "shaders/FragmentShader.glsl"
 
+#ifdef ADAPTIVE_RESOLUTION
+#define NUM_RENDER_LEVELS RESOLUTION_LEVELS
+#else
+#define NUM_RENDER_LEVELS 1
+#endif
+//the vertex that row or column index of a level lands on: every stride'th one, and always the last one of the grid
+#define LEVEL_POSITION(index, stride, numVertices) ((index)*(stride) < (numVertices) - 1 ? (index)*(stride) : (numVertices) - 1)
+
 /* major functions */
 int initOpenGL();
 int initOpenCL();
@@ -20,14 +38,26 @@ int deinitOpenGL();
 int initVertices();
 int updateVertices(int iterations);
 int Render();
+int printVertices();
 
 /* other supporting functions */
 int createVertexPositions();
 int deleteVertexPositions();
 int constructElementArray();
 int deleteElementArray();
+float rippleHeight(long x, long z, int iteration);
+double rippleEnvelope(long x0, long z0, long x1, long z1, int iteration);
 int setupOpenGLRender();
 int closeOpenGLRender();
+int updateHeightfieldQueries();
+int resolutionLevel();
+double frameBudget();
+long vertexBufferIndex(long x, long z);
+int buildFrameGraph();
+void beginFrameTask(void* data, int index);
+void computeTileTask(void* data, int tile);
+void uploadTileTask(void* data, int tile);
+void drawTileTask(void* data, int tile);
 
 /*global vars */
 //double vertex_positions[NUM_VERTICES_X][NUM_VERTICES_Z][3]; //This is the buffer for holding the vertex positions, and will be an openGL buffer eventually
@@ -49,7 +79,40 @@ GLint programID;
 GLuint vertex_buffer_object;
 MatrixSet g_matrix;
 GLint matrixUniformLocation;
-GLushort* indexArray;
+GLuint element_buffer_object;
+GLuint* indexArray;
+//where each resolution level starts in the element array, and its size in vertices
+long g_levelOffset[NUM_RENDER_LEVELS];
+long g_levelColumns[NUM_RENDER_LEVELS], g_levelRows[NUM_RENDER_LEVELS];
+#endif
+
+#ifdef DOMAIN_DECOMPOSITION
+DomainDecomposition g_domains;
+#endif
+#ifdef ACTIVE_REGIONS
+ActiveRegionTracker g_activeRegions;
+#endif
+#ifdef TILE_TASK_GRAPH
+TaskGraph g_frameGraph;
+int g_frameIteration; //the iteration the frame graph is currently computing
+char g_tileChanged[NUM_TILES]; //set by each tile's compute task, since the upload clears the dirty flag
+float* g_tileMajorPositions; //the vertices in the order of the OpenGL buffer, so each tile is uploaded in one call
+#endif
+#ifdef PUBLISH_HEIGHTFIELD
+HeightfieldPublisher g_publisher;
+#endif
+#ifdef HEIGHTFIELD_QUERIES
+HeightfieldQuery g_heightfieldQuery;
+#endif
+#ifdef ADAPTIVE_RESOLUTION
+ResolutionController g_resolution;
+GpuTimer g_gpuTimer;
+//the render stage is also timed on the GPU, since the draw calls return long before the GPU is done with them
+#define BEGIN_STAGE(stage) do { g_resolution.BeginStage(stage); if ((stage) == STAGE_RENDER) g_gpuTimer.Begin(); } while (0)
+#define END_STAGE(stage) do { if ((stage) == STAGE_RENDER) g_gpuTimer.End(); g_resolution.EndStage(stage); } while (0)
+#else
+#define BEGIN_STAGE(stage) ((void)0)
+#define END_STAGE(stage) ((void)0)
 #endif
 
 
@@ -57,6 +120,11 @@ GLushort* indexArray;
 int main()
 {
 	assert(createVertexPositions() == SUCCESS);
+	assert(constructElementArray() == SUCCESS);
+#ifdef DOMAIN_DECOMPOSITION
+	/* the workers are forked before any window or context exists */
+	assert(g_domains.Init(rippleHeight) == SUCCESS);
+#endif
 	/* initialize opengl */
 	assert(initWindow() == SUCCESS);
 	assert(glewInit() == GLEW_OK);
@@ -64,25 +132,107 @@ int main()
 	assert(initOpenGL() == SUCCESS);
 
 	assert(initVertices() == SUCCESS);
+#ifdef ACTIVE_REGIONS
+	g_activeRegions.Init(rippleHeight, rippleEnvelope);
+#endif
+#ifdef TILE_TASK_GRAPH
+	assert(buildFrameGraph() == SUCCESS);
+#endif
+#ifdef PUBLISH_HEIGHTFIELD
+	assert(g_publisher.Init(HEIGHTFIELD_SHM_NAME) == SUCCESS);
+#endif
+#ifdef HEIGHTFIELD_QUERIES
+	assert(g_heightfieldQuery.Init() == SUCCESS);
+#endif
+#ifdef ADAPTIVE_RESOLUTION
+	g_resolution.Init(frameBudget());
+	assert(g_gpuTimer.Init() == SUCCESS);
+#endif
 
 	/* loop for ten thousand iterations */
 	long i = 0;
 	while (i < ITERATIONS)
 	{
+#ifdef TILE_TASK_GRAPH
+		/* update, upload and draw the scene one tile at a time */
+		/* the update and the render overlap here, so the whole frame is counted as rendering */
+		BEGIN_STAGE(STAGE_RENDER);
+		g_frameIteration = i;
+		g_frameGraph.Run();
+#ifdef HEIGHTFIELD_QUERIES
+		assert(updateHeightfieldQueries() == SUCCESS);
+#endif
+		assert(closeOpenGLRender() == SUCCESS);
+		END_STAGE(STAGE_RENDER);
+#else
 		/* update the vertices */
+		BEGIN_STAGE(STAGE_UPDATE);
 		assert(updateVertices(i) == SUCCESS);
+#ifdef HEIGHTFIELD_QUERIES
+		/* before the upload, which clears the dirty tiles */
+		assert(updateHeightfieldQueries() == SUCCESS);
+#endif
+		END_STAGE(STAGE_UPDATE);
 		
+		BEGIN_STAGE(STAGE_RENDER);
 		assert(setupOpenGLRender() == SUCCESS);
 		/* render the new scene */
 		assert(Render() == SUCCESS);
 		assert(closeOpenGLRender() == SUCCESS);
+		END_STAGE(STAGE_RENDER);
+#endif
+		/* the swap may wait for vsync, and the dump is only as fast as the terminal, so neither one is timed.
+		* What the GPU spends on the frame is measured by the timer queries instead */
+		if (swapFlag)
+			SDL_GL_SwapWindow(window);
+		assert(printVertices() == SUCCESS);
+#ifdef PUBLISH_HEIGHTFIELD
+#if defined(ACTIVE_REGIONS) && !defined(DOMAIN_DECOMPOSITION)
+		assert(g_publisher.Publish(vertex_positions, i, 1 << resolutionLevel()) == SUCCESS);
+#else
+		assert(g_publisher.Publish(vertex_positions, i, 1) == SUCCESS);
+#endif
+#endif
+#ifdef ADAPTIVE_RESOLUTION
+		/* the GPU time comes from a frame or two back, so that reading it never waits on the GPU */
+		g_resolution.AddStageTime(STAGE_GPU, g_gpuTimer.Collect());
+		/* only the active region tiles can simulate at a coarser stride, everything else just draws fewer vertices */
+		if (g_resolution.EndFrame())
+		{
+#if defined(ACTIVE_REGIONS) && !defined(DOMAIN_DECOMPOSITION)
+			g_activeRegions.SetStride(g_resolution.GetStride());
+#endif
+		}
+#ifdef PUBLISH_HEIGHTFIELD
+		g_publisher.PublishMetrics(g_resolution.GetLevel(), g_resolution.GetBudget(), g_resolution.GetAverageFrameTime());
+#endif
+#endif
+		/* print whatever the driver reported during the frame */
+		OGL_DEBUG_FLUSH();
 		sleep(1);
 		i++;
 	}
 	/* clean up */
+#ifdef PUBLISH_HEIGHTFIELD
+	assert(g_publisher.Deinit() == SUCCESS);
+#endif
+#ifdef HEIGHTFIELD_QUERIES
+	g_heightfieldQuery.Deinit();
+#endif
+#ifdef TILE_TASK_GRAPH
+	g_frameGraph.Shutdown();
+	free(g_tileMajorPositions);
+#endif
+#ifdef ADAPTIVE_RESOLUTION
+	g_gpuTimer.Deinit();
+#endif
 	assert(deinitOpenGL() == SUCCESS);
 	assert(deinitOpenCL() == SUCCESS);
 	assert(deinitWindow() == SUCCESS);
+#ifdef DOMAIN_DECOMPOSITION
+	assert(g_domains.Shutdown() == SUCCESS);
+#endif
+	assert(deleteElementArray() == SUCCESS);
 	assert(deleteVertexPositions() == SUCCESS);
 	return 0;
 }
@@ -95,10 +245,21 @@ int main()
 int initOpenGL()
 {
 #ifdef OPENGL
+	if (OGL_DEBUG_INIT(OPENGL_DEBUG_SEVERITY) != SUCCESS) return FAILURE;
+
 	// Generate the buffer that will store the vertices
 	glGenBuffers(1, &vertex_buffer_object);
 	glBindBuffer(GL_ARRAY_BUFFER, vertex_buffer_object);
 	glBufferData(GL_ARRAY_BUFFER, sizeof(float)*NUM_VERTICES_X*NUM_VERTICES_Z*3, vertex_positions, GL_STREAM_DRAW);
+	OGL_DEBUG_LABEL(GL_BUFFER, vertex_buffer_object, "vertex_positions");
+
+	// and the one with the indices of every resolution level, which never changes
+	glGenBuffers(1, &element_buffer_object);
+	glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, element_buffer_object);
+	long numIndices = g_levelOffset[NUM_RENDER_LEVELS - 1] + g_levelColumns[NUM_RENDER_LEVELS - 1]*g_levelRows[NUM_RENDER_LEVELS - 1];
+	glBufferData(GL_ELEMENT_ARRAY_BUFFER, sizeof(GLuint)*numIndices, indexArray, GL_STATIC_DRAW);
+	glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, 0);
+	OGL_DEBUG_LABEL(GL_BUFFER, element_buffer_object, "indexArray");
 	//testing
 	//float test_buffer[] = { 0.75, 0.75, 0.0, 0.75, 0.25, 0.0, 0.25, 0.25, 0.0};
 	//glBufferData(GL_ARRAY_BUFFER, sizeof(float)*9, test_buffer, GL_STATIC_DRAW);
@@ -106,6 +267,7 @@ int initOpenGL()
 	//Compile the shaders
 	programID = MakeShaderProgram(OPENGL_VERTEX_SHADER, OPENGL_GEOMETRY_SHADER, OPENGL_FRAGMENT_SHADER, 1);
 	if (!programID) return FAILURE;
+	OGL_DEBUG_LABEL(GL_PROGRAM, programID, "ripple");
 
 	//register the uniform variables
 	matrixUniformLocation = glGetUniformLocation(programID, "transformationMatrix");
@@ -117,6 +279,7 @@ int deinitOpenGL()
 {
 #ifdef OPENGL
 	glDeleteBuffers(1, &vertex_buffer_object);
+	glDeleteBuffers(1, &element_buffer_object);
 #endif //OPENGL
 	return SUCCESS;
 }
@@ -135,9 +298,27 @@ int deinitOpenCL()
 int setupOpenGLRender()
 {
 #ifdef OPENGL
+	OGL_DEBUG_PUSH_GROUP("setup");
 	//Set the appropriate uniform variables
 	glUseProgram(programID);
 	glBindBuffer(GL_ARRAY_BUFFER, vertex_buffer_object);
+	glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, element_buffer_object);
+#if defined(TILE_TASK_GRAPH)
+	//each tile is uploaded by its own task
+#elif defined(ACTIVE_REGIONS)
+	//only send the parts of the surface that moved since the last upload
+	OGL_DEBUG_PUSH_GROUP("upload");
+	const stRange* ranges;
+	int numRanges = g_activeRegions.GetDirtyRanges(&ranges);
+	for (int i = 0; i < numRanges; i++)
+		glBufferSubData(GL_ARRAY_BUFFER, sizeof(float)*ranges[i].offset, sizeof(float)*ranges[i].count, vertex_positions + ranges[i].offset);
+	g_activeRegions.ClearDirty();
+	OGL_DEBUG_POP_GROUP();
+#else
+	OGL_DEBUG_PUSH_GROUP("upload");
+	glBufferSubData(GL_ARRAY_BUFFER, 0, sizeof(float)*NUM_VERTICES*3, vertex_positions);
+	OGL_DEBUG_POP_GROUP();
+#endif
 	g_matrix.SetCameraPosition(glm::vec3(-1.0, 0.2, 1.0));
 	glUniformMatrix4fv(matrixUniformLocation, 1, GL_FALSE, glm::value_ptr(g_matrix.GetFinalMatrix()));
 
@@ -145,7 +326,8 @@ int setupOpenGLRender()
 	//glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, 0, 0);
 	glEnableClientState(GL_VERTEX_ARRAY);
 	glVertexPointer(3, GL_FLOAT, 0, (void*)0);
-	OGLErrorCheck(__LINE__);
+	OGL_DEBUG_CHECK();
+	OGL_DEBUG_POP_GROUP();
 #endif //OPENGL
 	return SUCCESS;
 }
@@ -154,6 +336,7 @@ int closeOpenGLRender()
 #ifdef OPENGL
 	//glDisableVertexAttribArray(0);
 	glDisableClientState(GL_VERTEX_ARRAY);
+	glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, 0);
 	glBindBuffer(GL_ARRAY_BUFFER, 0);
 	glUseProgram(0);
 #endif //OPENGL
@@ -186,6 +369,10 @@ int initWindow()
 		SDL_WINDOW_OPENGL | SDL_WINDOW_SHOWN | SDL_WINDOW_RESIZABLE);
 
 	SDLCheckError(__LINE__);
+#ifdef OPENGL_DEBUG
+	//without this most drivers have very little to say through KHR_debug
+	SDL_GL_SetAttribute(SDL_GL_CONTEXT_FLAGS, SDL_GL_CONTEXT_DEBUG_FLAG);
+#endif
 	context = SDL_GL_CreateContext(window);
 	SDL_GL_SetAttribute(SDL_GL_CONTEXT_MAJOR_VERSION, 2);
 	SDL_GL_SetAttribute(SDL_GL_CONTEXT_MINOR_VERSION, 1);
@@ -248,11 +435,11 @@ int initVertices()
 	}*/
 	for (long z = 0; z < NUM_VERTICES_Z; z++)
 	{
-		float zScaled = z / NUM_VERTICES_Z;
+		float zScaled = (float)z / NUM_VERTICES_Z;
 		for (long x = 0; x < NUM_VERTICES_X; x++)
 		{
-			float xScaled = x / NUM_VERTICES_X;
-			int idx = z*x*3;
+			float xScaled = (float)x / NUM_VERTICES_X;
+			long idx = (z*NUM_VERTICES_X + x)*3;
 			vertex_positions[idx] = xScaled;
 			vertex_positions[(idx + 1)] = 0.0;
 			vertex_positions[(idx + 2)] = zScaled;
@@ -267,12 +454,18 @@ At each vertex, the new position is a function of the current time and the dista
 */
 int updateVertices(int iteration)
 {
-	/* take a snapshot of the time before beginning. Any time will do */
-	//time_t time = clock();
-	double time = (double)iteration / ITERATIONS;
-	//double time = (double)clock() / (double)CLOCKS_PER_SEC;
-	double centerPointX = NUM_VERTICES_X / 2;
-	double centerPointZ = NUM_VERTICES_Z / 2;
+#ifdef DOMAIN_DECOMPOSITION
+	//the worker processes own the subdomains, this just steps them and gathers the heights
+	if (g_domains.Step(iteration, vertex_positions) != SUCCESS)
+		return FAILURE;
+#ifdef ACTIVE_REGIONS
+	g_activeRegions.MarkAllDirty();
+#endif
+	return SUCCESS;
+#elif defined(ACTIVE_REGIONS)
+	g_activeRegions.Update(vertex_positions, iteration);
+	return SUCCESS;
+#else
 	/*for (int z = 0; z < NUM_VERTICES_Z; z++)
 	{
 		for (int x = 0; x < NUM_VERTICES_X; x++)
@@ -291,19 +484,139 @@ int updateVertices(int iteration)
 	}*/
 	for (long z = 0; z < NUM_VERTICES_Z; z++)
 	{
-		double dz = (z - centerPointZ) / NUM_VERTICES_Z;
 		for (long x = 0; x < NUM_VERTICES_X; x++)
 		{
-			double dx = (x - centerPointX) / NUM_VERTICES_X;
-			double distanceFromCenter = sqrt(pow(dx,2) + pow(dz,2));
-			vertex_positions[(x*z*3+1)] = amplitude * cos(omega*time + distanceFromCenter);
+			vertex_positions[((z*NUM_VERTICES_X + x)*3 + 1)] = rippleHeight(x, z, iteration);
 		}
 	}
 	return SUCCESS;
+#endif //DOMAIN_DECOMPOSITION
+}
+
+/* The height of one vertex, which is a function of the time and of its distance from the center */
+float rippleHeight(long x, long z, int iteration)
+{
+	/* take a snapshot of the time before beginning. Any time will do */
+	//time_t time = clock();
+	double time = (double)iteration / ITERATIONS;
+	//double time = (double)clock() / (double)CLOCKS_PER_SEC;
+	double centerPointX = NUM_VERTICES_X / 2;
+	double centerPointZ = NUM_VERTICES_Z / 2;
+	double dx = (x - centerPointX) / NUM_VERTICES_X;
+	double dz = (z - centerPointZ) / NUM_VERTICES_Z;
+	double distanceFromCenter = sqrt(pow(dx,2) + pow(dz,2));
+#ifdef RIPPLE_WAVE_SPEED
+	//the surface is still flat ahead of the wavefront
+	if (distanceFromCenter > RIPPLE_WAVE_SPEED*time)
+		return 0.0;
+#endif
+#ifdef RIPPLE_DAMPING
+	return amplitude * exp(-RIPPLE_DAMPING*distanceFromCenter) * cos(omega*time + distanceFromCenter);
+#else
+	return amplitude * cos(omega*time + distanceFromCenter);
+#endif
 }
 
-/* This just prints to the screen right now, but later it will be a whole bunch of opengl work */
+/* The largest height that rippleHeight() can give anywhere in [x0, x1) x [z0, z1).
+* Both the wavefront and the damping only depend on the distance from the center, so it is enough to look at the
+* vertex of the block that is closest to the center */
+double rippleEnvelope(long x0, long z0, long x1, long z1, int iteration)
+{
+#if !defined(RIPPLE_WAVE_SPEED) && !defined(RIPPLE_DAMPING)
+	//the whole surface moves all the time
+	return amplitude;
+#else
+	double centerPointX = NUM_VERTICES_X / 2;
+	double centerPointZ = NUM_VERTICES_Z / 2;
+	double nearestX = centerPointX < x0 ? x0 : (centerPointX > x1 - 1 ? x1 - 1 : centerPointX);
+	double nearestZ = centerPointZ < z0 ? z0 : (centerPointZ > z1 - 1 ? z1 - 1 : centerPointZ);
+	double dx = (nearestX - centerPointX) / NUM_VERTICES_X;
+	double dz = (nearestZ - centerPointZ) / NUM_VERTICES_Z;
+	double distanceFromCenter = sqrt(pow(dx,2) + pow(dz,2));
+#ifdef RIPPLE_WAVE_SPEED
+	double time = (double)iteration / ITERATIONS;
+	if (distanceFromCenter > RIPPLE_WAVE_SPEED*time)
+		return 0.0;
+#endif
+#ifdef RIPPLE_DAMPING
+	return amplitude * exp(-RIPPLE_DAMPING*distanceFromCenter);
+#else
+	return amplitude;
+#endif
+#endif //RIPPLE_WAVE_SPEED || RIPPLE_DAMPING
+}
+
+/* Brings the query pyramid up to date with whatever parts of the surface changed this frame */
+int updateHeightfieldQueries()
+{
+#ifdef HEIGHTFIELD_QUERIES
+#if defined(ACTIVE_REGIONS)
+	for (int tile = 0; tile < NUM_TILES; tile++)
+	{
+#ifdef TILE_TASK_GRAPH
+		if (!g_tileChanged[tile])
+			continue;
+#else
+		if (!g_activeRegions.IsTileDirty(tile))
+			continue;
+#endif
+		long x0, z0, x1, z1;
+		g_activeRegions.GetTileBounds(tile, &x0, &z0, &x1, &z1);
+		g_heightfieldQuery.MarkDirty(x0, z0, x1, z1);
+	}
+#else
+	g_heightfieldQuery.MarkAllDirty();
+#endif
+	g_heightfieldQuery.Rebuild(vertex_positions);
+#endif //HEIGHTFIELD_QUERIES
+	return SUCCESS;
+}
+
+/* Where vertex (x, z) is in the OpenGL vertex buffer, which is tile major when the tiles are uploaded one at a time */
+long vertexBufferIndex(long x, long z)
+{
+#ifdef TILE_TASK_GRAPH
+	return g_activeRegions.GetTileMajorIndex(x, z);
+#else
+	return z*NUM_VERTICES_X + x;
+#endif
+}
+
+/* The frame time that ADAPTIVE_RESOLUTION aims for, in milliseconds: a share of the display's refresh interval */
+double frameBudget()
+{
+	SDL_DisplayMode mode;
+	int refreshRate = DEFAULT_REFRESH_RATE;
+	if (SDL_GetCurrentDisplayMode(SDL_GetWindowDisplayIndex(window), &mode) == 0 && mode.refresh_rate > 0)
+		refreshRate = mode.refresh_rate;
+	return FRAME_BUDGET_FRACTION*1000.0 / refreshRate;
+}
+
+/* The resolution level the surface is drawn at this frame, 0 being every vertex */
+int resolutionLevel()
+{
+#ifdef ADAPTIVE_RESOLUTION
+	return g_resolution.GetLevel();
+#else
+	return 0;
+#endif
+}
+
+/* Draws the surface at the current resolution level. The caller swaps the buffers */
 int Render()
+{
+	OGL_DEBUG_PUSH_GROUP("draw");
+	glClearColor(0.0, 0.0, 0.0, 0.0);
+	glClear(GL_COLOR_BUFFER_BIT);
+	int level = resolutionLevel();
+	glDrawElements(GL_LINE_STRIP, g_levelColumns[level]*g_levelRows[level], GL_UNSIGNED_INT, (void*)(sizeof(GLuint)*g_levelOffset[level]));
+	//glDrawArrays(GL_TRIANGLES, 0, 3);//testing
+	OGL_DEBUG_POP_GROUP();
+	return SUCCESS;
+}
+
+/* Prints the heights to the screen */
+int printVertices()
 {
 	/*for (int z = 0; z < NUM_VERTICES_Z; z++)
 	{
@@ -321,16 +634,10 @@ int Render()
 	{
 		for (int x = 0; x < NUM_VERTICES_X; x++)
 		{
-			printf(" %f ", vertex_positions[(x*z*3+1)]);
+			printf(" %f ", vertex_positions[((z*NUM_VERTICES_X + x)*3 + 1)]);
 		}
 		printf("\n");
 	}
-	glClearColor(0.0, 0.0, 0.0, 0.0);
-	glClear(GL_COLOR_BUFFER_BIT);
-	glDrawArrays(GL_LINE_STRIP, 0, NUM_VERTICES);
-	//glDrawArrays(GL_TRIANGLES, 0, 3);//testing
-	if (swapFlag)
-		SDL_GL_SwapWindow(window);
 	printf("\n\n");
 	return SUCCESS;
 }
@@ -384,23 +691,147 @@ int deleteVertexPositions()
 	return SUCCESS;
 }
 
+/*
+* The index array holds every resolution level one after the other. Level n runs row by row over every (1 << n)th
+* vertex in x and z, plus the last row and column of the grid, so a coarse surface still covers the whole grid.
+*/
 int constructElementArray()
 {
-	//the index array will break the vertices into n - 1 * n - 1 squares that each form 2 triangles(or 6 indexes)
-	int idx = 0;
-	indexArray = (GLushort*)malloc(sizeof(GLushort)*(NUM_VERTICES_X - 1)*(NUM_VERTICES_Z - 1)*6);
+#ifdef OPENGL
+	long numIndices = 0;
+	for (int level = 0; level < NUM_RENDER_LEVELS; level++)
+	{
+		long stride = 1 << level;
+		g_levelOffset[level] = numIndices;
+		g_levelColumns[level] = (NUM_VERTICES_X - 1 + stride - 1) / stride + 1;
+		g_levelRows[level] = (NUM_VERTICES_Z - 1 + stride - 1) / stride + 1;
+		numIndices += g_levelColumns[level]*g_levelRows[level];
+	}
+	indexArray = (GLuint*)malloc(sizeof(GLuint)*numIndices);
+	if (!indexArray)
+		return FAILURE;
 
-	for (int z = 0; z < NUM_VERTICES_Z - 1; z++)
+	long idx = 0;
+	for (int level = 0; level < NUM_RENDER_LEVELS; level++)
 	{
-		for (int x = 0; x < NUM_VERTICES_X - 1; x++)
+		long stride = 1 << level;
+		for (long row = 0; row < g_levelRows[level]; row++)
 		{
-			idx++;
+			long z = LEVEL_POSITION(row, stride, NUM_VERTICES_Z);
+			for (long column = 0; column < g_levelColumns[level]; column++)
+				indexArray[idx++] = vertexBufferIndex(LEVEL_POSITION(column, stride, NUM_VERTICES_X), z);
 		}
 	}
+#endif //OPENGL
 	return SUCCESS;
 }
 int deleteElementArray()
 {
+#ifdef OPENGL
 	free(indexArray);
+#endif //OPENGL
+	return SUCCESS;
+}
+
+
+/*
+* The frame graph. Every tile gets a compute task that can run on any thread, followed by an upload and a draw
+* that have to run on the thread with the OpenGL context. A single task at the start sets up the program and
+* clears the screen, and the uploads and draws wait for it. A draw also waits for the upload of the tile to the
+* east, since its rows run one vertex into that tile. Since each tile only waits on its own compute and its
+* neighbour's, the first tiles are being drawn while the rest are still being computed.
+*/
+int buildFrameGraph()
+{
+#ifdef TILE_TASK_GRAPH
+	g_tileMajorPositions = (float*)malloc(sizeof(float)*NUM_VERTICES*3);
+	int* uploads = (int*)malloc(sizeof(int)*NUM_TILES);
+	int* draws = (int*)malloc(sizeof(int)*NUM_TILES);
+	if (!g_tileMajorPositions || !uploads || !draws || g_frameGraph.Init(1 + 3*NUM_TILES, 4*NUM_TILES, NUM_WORKER_THREADS) != SUCCESS)
+	{
+		free(uploads); free(draws);
+		return FAILURE;
+	}
+	int result = SUCCESS;
+	int begin = g_frameGraph.AddTask(beginFrameTask, NULL, 0, TASK_MAIN_THREAD);
+	for (int tile = 0; tile < NUM_TILES; tile++)
+	{
+		int compute = g_frameGraph.AddTask(computeTileTask, NULL, tile, TASK_ANY_THREAD);
+		uploads[tile] = g_frameGraph.AddTask(uploadTileTask, NULL, tile, TASK_MAIN_THREAD);
+		draws[tile] = g_frameGraph.AddTask(drawTileTask, NULL, tile, TASK_MAIN_THREAD);
+		if (g_frameGraph.AddDependency(compute, uploads[tile]) != SUCCESS ||
+			g_frameGraph.AddDependency(begin, uploads[tile]) != SUCCESS ||
+			g_frameGraph.AddDependency(uploads[tile], draws[tile]) != SUCCESS)
+			result = FAILURE;
+	}
+	for (int tile = 0; tile < NUM_TILES; tile++)
+	{
+		if (tile % NUM_TILES_X < NUM_TILES_X - 1 && g_frameGraph.AddDependency(uploads[tile + 1], draws[tile]) != SUCCESS)
+			result = FAILURE;
+	}
+	free(uploads); free(draws);
+	return result;
+#else
 	return SUCCESS;
+#endif //TILE_TASK_GRAPH
+}
+void beginFrameTask(void* data, int index)
+{
+	setupOpenGLRender();
+	OGL_DEBUG_PUSH_GROUP("clear");
+	glClearColor(0.0, 0.0, 0.0, 0.0);
+	glClear(GL_COLOR_BUFFER_BIT);
+	OGL_DEBUG_POP_GROUP();
+}
+void computeTileTask(void* data, int tile)
+{
+#ifdef TILE_TASK_GRAPH
+	g_tileChanged[tile] = g_activeRegions.UpdateTile(tile, vertex_positions, g_frameIteration);
+	//packed here rather than in the upload, so that the copying is spread over the workers too
+	if (g_activeRegions.IsTileDirty(tile))
+		g_activeRegions.PackTile(tile, vertex_positions, g_tileMajorPositions);
+#endif
+}
+/* the vertex buffer is tile major, so the whole tile is one run */
+void uploadTileTask(void* data, int tile)
+{
+#ifdef TILE_TASK_GRAPH
+	if (!g_activeRegions.IsTileDirty(tile))
+		return;
+	long x0, z0, x1, z1;
+	g_activeRegions.GetTileBounds(tile, &x0, &z0, &x1, &z1);
+	long offset = g_activeRegions.GetTileOffset(tile)*3;
+	OGL_DEBUG_PUSH_GROUP("upload tile");
+	glBufferSubData(GL_ARRAY_BUFFER, sizeof(float)*offset, sizeof(float)*(x1 - x0)*(z1 - z0)*3, g_tileMajorPositions + offset);
+	g_activeRegions.ClearTileDirty(tile);
+	OGL_DEBUG_POP_GROUP();
+#endif
+}
+/*
+* one line strip per row of the tile at the current level, all in one call, running one column into the next tile
+* so that the rows join up. The tile edges fall on every level's stride, so the columns and rows of a tile are easy
+* to find
+*/
+void drawTileTask(void* data, int tile)
+{
+#ifdef TILE_TASK_GRAPH
+	long x0, z0, x1, z1;
+	g_activeRegions.GetTileBounds(tile, &x0, &z0, &x1, &z1);
+	int level = resolutionLevel();
+	long stride = 1 << level;
+	long firstColumn = x0 / stride;
+	long lastColumn = x1 < NUM_VERTICES_X ? x1 / stride : g_levelColumns[level] - 1;
+	GLsizei counts[ACTIVE_TILE_SIZE + 1];
+	const GLvoid* firsts[ACTIVE_TILE_SIZE + 1];
+	int numRows = 0;
+	for (long row = z0 / stride; row < g_levelRows[level] && LEVEL_POSITION(row, stride, NUM_VERTICES_Z) < z1; row++)
+	{
+		counts[numRows] = lastColumn - firstColumn + 1;
+		firsts[numRows] = (const GLvoid*)(sizeof(GLuint)*(g_levelOffset[level] + row*g_levelColumns[level] + firstColumn));
+		numRows++;
+	}
+	OGL_DEBUG_PUSH_GROUP("draw tile");
+	glMultiDrawElements(GL_LINE_STRIP, counts, GL_UNSIGNED_INT, firsts, numRows);
+	OGL_DEBUG_POP_GROUP();
+#endif
 }